@@ -4,42 +4,836 @@
 // see https://create.stephan-brumme.com/length-limited-prefix-codes/
 //
 
-// gcc benchmark.c packagemerge.c limited*.c moffat.c -o benchmark -Wall -O3
+// gcc benchmark.c perfcounters.c packagemerge.c limited*.c moffat.c twoqueue.c codecache.c slidingwindow.c jpegtables.c deflateheader.c blocksplit.c multitable.c lengthlimitstats.c -o benchmark -Wall -O3 -pthread
+// or: make liblengthlimit.a && gcc benchmark.c perfcounters.c liblengthlimit.a -o benchmark -Wall -O3 -pthread
 
-#include "packagemerge.h"
-#include "moffat.h"
-#include "limitedjpegdeflate.h"
-#include "limitedbzip2.h"
-#include "limitedkraft.h"
-#include "limitedkraftheap.h"
+// clock_gettime
+#define _POSIX_C_SOURCE 199309L
+
+#include "lengthlimit.h"
+#include "perfcounters.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define MAXSYMBOLS 256
 
 // histogram of first 64k of enwik dataset from http://mattmahoney.net/dc/textdata.html
 // created by histogram.c
-unsigned int histogram[MAXSYMBOLS] = { 0,0,0,0,0,0,0,0,0,0,538,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,8289,6,72,31,0,1,309,509,57,58,58,0,448,278,565,490,150,215,94,61,57,71,47,53,87,123,195,345,294,151,293,12,0,275,85,153,50,97,76,64,56,134,40,33,66,113,58,33,116,5,98,147,172,33,17,84,3,11,19,1172,0,1173,0,35,0,4125,472,1866,1424,4746,918,776,2091,4112,73,308,1796,1593,3528,3514,1109,177,3069,3334,4336,1288,513,535,179,670,58,64,171,64,3,0,6,0,5,2,5,3,0,0,2,1,3,0,2,0,0,0,4,0,0,1,2,2,1,2,4,2,0,2,1,1,0,1,4,1,3,0,1,1,2,2,1,15,2,2,0,2,0,2,4,1,2,7,2,0,0,4,17,2,3,1,3,3,0,1,0,0,0,25,2,1,0,0,0,0,0,0,0,0,0,0,19,7,0,0,0,0,0,7,10,6,0,1,0,0,0,0,14,0,3,5,2,1,2,0,0,0,0,1,2,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
+unsigned int defaultHistogram[MAXSYMBOLS] = { 0,0,0,0,0,0,0,0,0,0,538,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,8289,6,72,31,0,1,309,509,57,58,58,0,448,278,565,490,150,215,94,61,57,71,47,53,87,123,195,345,294,151,293,12,0,275,85,153,50,97,76,64,56,134,40,33,66,113,58,33,116,5,98,147,172,33,17,84,3,11,19,1172,0,1173,0,35,0,4125,472,1866,1424,4746,918,776,2091,4112,73,308,1796,1593,3528,3514,1109,177,3069,3334,4336,1288,513,535,179,670,58,64,171,64,3,0,6,0,5,2,5,3,0,0,2,1,3,0,2,0,0,0,4,0,0,1,2,2,1,2,4,2,0,2,1,1,0,1,4,1,3,0,1,1,2,2,1,15,2,2,0,2,0,2,4,1,2,7,2,0,0,4,17,2,3,1,3,3,0,1,0,0,0,25,2,1,0,0,0,0,0,0,0,0,0,0,19,7,0,0,0,0,0,7,10,6,0,1,0,0,0,0,14,0,3,5,2,1,2,0,0,0,0,1,2,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
 
 // histogram of first 64k of calgary/obj2: head -c65536 calgary/obj2 | ./histogram -
-//unsigned int histogram[MAXSYMBOLS] = { 12987,1389,1275,416,749,560,562,320,642,179,361,72,547,138,244,49,521,96,180,85,121,62,103,46,167,77,111,75,83,65,131,288,1768,77,569,852,129,48,93,33,178,44,273,62,82,231,893,674,587,187,236,111,88,47,63,30,89,51,162,22,1140,253,144,1206,571,340,456,168,182,138,76,65,1530,65,281,61,230,64,1838,157,277,114,208,175,172,131,233,89,121,72,78,12,71,19,216,519,352,410,97,181,182,617,331,397,143,488,243,65,250,214,1759,424,340,30,405,310,645,352,55,105,148,67,148,13,119,7,29,31,284,40,52,19,30,12,25,36,189,13,67,8,74,29,38,295,114,83,48,21,24,7,77,38,115,100,130,13,57,9,66,92,468,139,68,10,54,7,57,40,222,760,167,5,30,901,87,19,93,13,49,9,45,7,14,4,52,4,94,13,64,2,34,7,236,87,52,41,38,7,56,13,47,11,34,8,40,17,117,48,247,157,73,51,58,10,37,24,193,9,41,3,77,19,70,102,96,19,201,42,62,108,146,89,80,15,116,102,61,75,136,77,652,28,116,25,41,16,118,6,182,36,353,151,506,200,663,2443 };
+//unsigned int defaultHistogram[MAXSYMBOLS] = { 12987,1389,1275,416,749,560,562,320,642,179,361,72,547,138,244,49,521,96,180,85,121,62,103,46,167,77,111,75,83,65,131,288,1768,77,569,852,129,48,93,33,178,44,273,62,82,231,893,674,587,187,236,111,88,47,63,30,89,51,162,22,1140,253,144,1206,571,340,456,168,182,138,76,65,1530,65,281,61,230,64,1838,157,277,114,208,175,172,131,233,89,121,72,78,12,71,19,216,519,352,410,97,181,182,617,331,397,143,488,243,65,250,214,1759,424,340,30,405,310,645,352,55,105,148,67,148,13,119,7,29,31,284,40,52,19,30,12,25,36,189,13,67,8,74,29,38,295,114,83,48,21,24,7,77,38,115,100,130,13,57,9,66,92,468,139,68,10,54,7,57,40,222,760,167,5,30,901,87,19,93,13,49,9,45,7,14,4,52,4,94,13,64,2,34,7,236,87,52,41,38,7,56,13,47,11,34,8,40,17,117,48,247,157,73,51,58,10,37,24,193,9,41,3,77,19,70,102,96,19,201,42,62,108,146,89,80,15,116,102,61,75,136,77,652,28,116,25,41,16,118,6,182,36,353,151,506,200,663,2443 };
+
+// same interface as all length-limiting algorithms
+typedef unsigned char (*Algorithm)(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+// adapter for Moffat's algorithm
+static unsigned char moffatIgnoreLimit(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+{
+  (void) maxLength; // unused
+  return moffat(numCodes, histogram, codeLengths);
+}
+
+// adapter for the two-queue algorithm
+static unsigned char twoQueueIgnoreLimit(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+{
+  (void) maxLength; // unused
+  return twoQueue(numCodes, histogram, codeLengths);
+}
+
+// code cache, shared by all invocations of cachedPackageMerge
+static CodeCache* cache = NULL;
+// tolerate up to 0.1% worse code lengths
+#define CACHE_TOLERANCE 0.001
+
+// adapter for the code cache
+static unsigned char cachedPackageMerge(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+{
+  return codeCacheLookup(cache, packageMerge, maxLength, numCodes, histogram, codeLengths);
+}
+
+// accept up to 0.1% loss compared to optimal code lengths
+#define AUTO_BUDGET 0.001
+
+// adapter for automatic algorithm selection
+static unsigned char autoSelect(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+{
+  return limitedAuto(maxLength, numCodes, histogram, codeLengths, AUTO_BUDGET);
+}
+
+// run an algorithm for each histogram, repeat multiple times, return longest code length (0 if any call failed)
+static unsigned char run(Algorithm algorithm, unsigned char limitBits, int repeat,
+                         unsigned int numHistograms, const unsigned int* histograms, unsigned char* codeLengths)
+{
+  unsigned char result = 0;
+  int i;
+  for (i = 0; i < repeat; i++)
+  {
+    // each repetition starts with an empty cache
+    if (cache != NULL)
+      codeCacheClear(cache);
+
+    result = 0;
+    unsigned int current;
+    for (current = 0; current < numHistograms; current++)
+    {
+      unsigned char maxBits = algorithm(limitBits, MAXSYMBOLS, histograms + current * MAXSYMBOLS, codeLengths + current * MAXSYMBOLS);
+      if (maxBits == 0)
+        return 0;
+      if (result < maxBits)
+        result = maxBits;
+    }
+  }
+  return result;
+}
+
+// total size of encoded data (without overhead of Huffman tables)
+static unsigned long long totalBits(unsigned int numHistograms, const unsigned int* histograms, const unsigned char* codeLengths)
+{
+  unsigned long long result = 0;
+  unsigned int i;
+  for (i = 0; i < numHistograms * MAXSYMBOLS; i++)
+    result += codeLengths[i] * (unsigned long long) histograms[i];
+  return result;
+}
+
+// total size of DEFLATE's dynamic block headers: each histogram is a block of literals only (end-of-block symbol isn't counted)
+static unsigned long long totalHeaderBits(unsigned int numHistograms, unsigned int numCodes, const unsigned char* codeLengths)
+{
+  unsigned long long result = 0;
+  unsigned char litLengths [DEFLATE_NUM_LITERALS];
+  unsigned char distLengths[DEFLATE_NUM_DISTANCES] = { 0 };
+  unsigned int current;
+  for (current = 0; current < numHistograms; current++)
+  {
+    unsigned int i;
+    for (i = 0; i < DEFLATE_NUM_LITERALS; i++)
+      litLengths[i] = i < numCodes ? codeLengths[current * MAXSYMBOLS + i] : 0;
+    result += 3 + deflateHeaderBits(litLengths, distLengths, NULL, NULL);
+  }
+  return result;
+}
+
+
+// ----- stream modes: these functions need the original data instead of histograms -----
+
+// sliding window settings
+#define WINDOW_SIZE      16384
+#define WINDOW_THRESHOLD 1000
+
+// read a whole file (or STDIN), return NULL if error
+static unsigned char* readFile(const char* filename, unsigned int* numBytes)
+{
+  FILE* handle = stdin;
+  if (filename[0] != '-' || filename[1] != 0)
+    handle = fopen(filename, "rb");
+  if (!handle)
+    return NULL;
+
+  unsigned char* data = NULL;
+  *numBytes = 0;
+  for (;;)
+  {
+    data = (unsigned char*) realloc(data, *numBytes + 65536);
+    size_t numRead = fread(data + *numBytes, 1, 65536, handle);
+    if (numRead == 0)
+      break;
+    *numBytes += numRead;
+  }
+
+  fclose(handle);
+  return data;
+}
+
+// compress each byte with adaptive code lengths (sliding window) and compare to a single code for the whole file
+static int benchmarkSlidingWindow(unsigned char limitBits, const unsigned char* data, unsigned int numBytes)
+{
+  SlidingWindow window;
+  if (!slidingWindowInit(&window, packageMerge, limitBits, MAXSYMBOLS, WINDOW_SIZE, WINDOW_THRESHOLD))
+    return 2;
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  clock_t start = clock();
+  unsigned long long adaptive = 0;
+  for (i = 0; i < numBytes; i++)
+  {
+    slidingWindowAdd(&window, data[i]);
+    adaptive += window.codeLengths[data[i]];
+  }
+  double seconds = (clock() - start) / (double) CLOCKS_PER_SEC;
+
+  // sliding window failed ?
+  if (window.maxBits == 0)
+  {
+    slidingWindowFree(&window);
+    printf("BITS is too small (%d), no valid code possible\n", limitBits);
+    return 3;
+  }
+
+  // incremental updates must match a full re-computation
+  unsigned long long cost = 0;
+  for (i = 0; i < MAXSYMBOLS; i++)
+    cost += window.codeLengths[i] * (unsigned long long) window.histogram[i];
+  int costOk = cost == window.cost;
+  // sum(h * log2(h)) accumulates rounding errors, a rebuild computes it from scratch
+  double sumHLogH = window.sumHLogH;
+  unsigned int numRebuilds = window.numRebuilds;
+  slidingWindowRebuild(&window);
+  double drift = sumHLogH - window.sumHLogH;
+
+  // a single code for the whole file
+  unsigned int  histogram  [MAXSYMBOLS] = { 0 };
+  unsigned char codeLengths[MAXSYMBOLS];
+  for (i = 0; i < numBytes; i++)
+    histogram[data[i]]++;
+  packageMerge(limitBits, MAXSYMBOLS, histogram, codeLengths);
+  unsigned long long single = 0;
+  for (i = 0; i < MAXSYMBOLS; i++)
+    single += codeLengths[i] * (unsigned long long) histogram[i];
+
+  printf("sliding window: %d symbols, rebuild if loss exceeds %d bits, packageMerge limited to %d bits\n", WINDOW_SIZE, WINDOW_THRESHOLD, limitBits);
+  printf("%d bytes => %lld bits (%.2f%%), %d rebuilds, %.3f s (%.3f us per byte)\n",
+         numBytes, adaptive, 100.0 * adaptive / (8.0 * numBytes), numRebuilds, seconds, 1e6 * seconds / numBytes);
+  printf("single code for the whole file: %lld bits (%.2f%%)\n", single, 100.0 * single / (8.0 * numBytes));
+  printf("check incremental updates: cost %s, sum(h * log2(h)) drifted by %.2g bits\n", costOk ? "ok" : "FAILED", drift);
+
+  slidingWindowFree(&window);
+  return 0;
+}
+
+// block splitting settings
+#define BLOCK_MIN_SIZE 1024
+#define BLOCK_OVERHEAD 500
+#define BLOCK_MAX      256
+
+// size of a block with its own optimal code (without overhead), 0 if error
+static unsigned long long blockBits(unsigned char limitBits, const unsigned char* data, unsigned int from, unsigned int to)
+{
+  unsigned int  histogram  [MAXSYMBOLS] = { 0 };
+  unsigned char codeLengths[MAXSYMBOLS];
+  unsigned int i;
+  for (i = from; i < to; i++)
+    histogram[data[i]]++;
+  if (packageMerge(limitBits, MAXSYMBOLS, histogram, codeLengths) == 0)
+    return 0;
+
+  unsigned long long result = 0;
+  for (i = 0; i < MAXSYMBOLS; i++)
+    result += codeLengths[i] * (unsigned long long) histogram[i];
+  return result;
+}
+
+// split a file into blocks with their own codes and compare to fixed block sizes
+static int benchmarkBlockSplit(unsigned char limitBits, const unsigned char* data, unsigned int numBytes)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  // blockSplit() expects 16 bit symbols
+  unsigned short* symbols = (unsigned short*) malloc(sizeof(unsigned short) * numBytes);
+  for (i = 0; i < numBytes; i++)
+    symbols[i] = data[i];
+
+  unsigned int blockStarts[BLOCK_MAX];
+  unsigned long long total = 0;
+  clock_t start = clock();
+  unsigned int numBlocks = blockSplit(limitBits, MAXSYMBOLS, numBytes, symbols, BLOCK_MIN_SIZE, BLOCK_OVERHEAD, BLOCK_MAX, packageMerge, blockStarts, &total);
+  double seconds = (clock() - start) / (double) CLOCKS_PER_SEC;
+  free(symbols);
+
+  if (numBlocks == 0)
+  {
+    printf("BITS is too small (%d), no valid code possible\n", limitBits);
+    return 3;
+  }
+
+  // recompute each block's size, blocks must be in ascending order and not too small
+  unsigned long long check = 0;
+  int valid = blockStarts[0] == 0;
+  for (i = 0; i < numBlocks; i++)
+  {
+    unsigned int to = i + 1 < numBlocks ? blockStarts[i + 1] : numBytes;
+    if (to < blockStarts[i] + BLOCK_MIN_SIZE && numBlocks > 1)
+      valid = 0;
+    check += blockBits(limitBits, data, blockStarts[i], to) + BLOCK_OVERHEAD;
+  }
+
+  printf("block splitting: min. %d symbols per block, %d bits overhead per block, packageMerge limited to %d bits\n", BLOCK_MIN_SIZE, BLOCK_OVERHEAD, limitBits);
+  printf("%d bytes => %d blocks, %lld bits (%.2f%%) including overhead, %.3f s\n",
+         numBytes, numBlocks, total, 100.0 * total / (8.0 * numBytes), seconds);
+  printf("check blocks: %s\n", valid && check == total ? "ok" : "FAILED");
+
+  // compare to a single block and fixed block sizes
+  unsigned int blockSize = numBytes;
+  for (;;)
+  {
+    unsigned long long fixed = 0;
+    unsigned int numFixed = 0;
+    unsigned int from;
+    for (from = 0; from < numBytes; from += blockSize, numFixed++)
+      fixed += blockBits(limitBits, data, from, from + blockSize < numBytes ? from + blockSize : numBytes) + BLOCK_OVERHEAD;
+    printf("%s %d bytes: %d blocks, %lld bits (%.2f%%)\n", blockSize == numBytes ? "single block of" : "fixed blocks of",
+           blockSize, numFixed, fixed, 100.0 * fixed / (8.0 * numBytes));
+
+    // 64k, 16k, 4k
+    if (blockSize > 65536)
+      blockSize = 65536;
+    else if (blockSize > 4096)
+      blockSize /= 4;
+    else
+      break;
+  }
+
+  return valid && check == total ? 0 : 3;
+}
+
+// DEFLATE header optimization settings
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_WINDOW    32768
+
+// smallest match length / distance of DEFLATE's length symbols 257 ... 285 and distance symbols 0 ... 29
+static const unsigned short lengthBase  [DEFLATE_NUM_LITERALS - 257] =
+  { 3,4,5,6,7,8,9,10, 11,13,15,17, 19,23,27,31, 35,43,51,59, 67,83,99,115, 131,163,195,227, 258 };
+static const unsigned short distanceBase[DEFLATE_NUM_DISTANCES] =
+  { 1,2,3,4, 5,7, 9,13, 17,25, 33,49, 65,97, 129,193, 257,385, 513,769, 1025,1537, 2049,3073, 4097,6145, 8193,12289, 16385,24577 };
+
+// histograms of a block found by a simple greedy LZ77 matcher (a single candidate per hash), matches don't cross the block's end
+static void deflateHistograms(const unsigned char* data, unsigned int from, unsigned int to, unsigned int* head,
+                              unsigned int litHistogram[DEFLATE_NUM_LITERALS], unsigned int distHistogram[DEFLATE_NUM_DISTANCES])
+{
+  unsigned int i;
+  for (i = 0; i < DEFLATE_NUM_LITERALS; i++)
+    litHistogram[i] = 0;
+  for (i = 0; i < DEFLATE_NUM_DISTANCES; i++)
+    distHistogram[i] = 0;
+
+  unsigned int pos = from;
+  while (pos < to)
+  {
+    unsigned int length = 0;
+    unsigned int distance = 0;
+    if (pos + 3 <= to)
+    {
+      unsigned int hash = ((data[pos] << 16 | data[pos + 1] << 8 | data[pos + 2]) * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+      // head stores position + 1, 0 means "empty"
+      unsigned int candidate = head[hash];
+      head[hash] = pos + 1;
+      if (candidate > 0 && pos - (candidate - 1) <= DEFLATE_WINDOW)
+      {
+        candidate--;
+        unsigned int maxLength = to - pos < 258 ? to - pos : 258;
+        while (length < maxLength && data[candidate + length] == data[pos + length])
+          length++;
+        distance = pos - candidate;
+      }
+    }
+
+    if (length >= 3)
+    {
+      unsigned int symbol = DEFLATE_NUM_LITERALS - 257 - 1;
+      while (lengthBase[symbol] > length)
+        symbol--;
+      litHistogram[257 + symbol]++;
+      symbol = DEFLATE_NUM_DISTANCES - 1;
+      while (distanceBase[symbol] > distance)
+        symbol--;
+      distHistogram[symbol]++;
+      pos += length;
+    }
+    else
+    {
+      litHistogram[data[pos]]++;
+      pos++;
+    }
+  }
+
+  // end-of-block
+  litHistogram[256]++;
+}
+
+// sum of 2^-length in units of 2^-15
+static unsigned int deflateKraft(unsigned int numCodes, const unsigned char codeLengths[])
+{
+  unsigned int result = 0;
+  unsigned int i;
+  for (i = 0; i < numCodes; i++)
+    if (codeLengths[i] > 0)
+      result += 1 << (DEFLATE_MAX_LENGTH - codeLengths[i]);
+  return result;
+}
+
+// split a file into 4k and 16k blocks and shrink their DEFLATE headers
+static int benchmarkDeflateHeader(unsigned char limitBits, const unsigned char* data, unsigned int numBytes)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  if (limitBits > DEFLATE_MAX_LENGTH)
+  {
+    printf("BITS is too large (%d), DEFLATE allows at most %d bits\n", limitBits, DEFLATE_MAX_LENGTH);
+    return 3;
+  }
+
+  printf("DEFLATE headers: greedy LZ77, packageMerge limited to %d bits, deflateOptimizeLengths\n", limitBits);
+
+  unsigned int* head = (unsigned int*) malloc(sizeof(unsigned int) << DEFLATE_HASH_BITS);
+
+  int result = 0;
+  unsigned int blockSize;
+  for (blockSize = 4096; blockSize <= 16384; blockSize *= 4)
+  {
+    for (i = 0; i < (1U << DEFLATE_HASH_BITS); i++)
+      head[i] = 0;
+
+    unsigned long long before = 0, after = 0, headerBits = 0;
+    unsigned int numBlocks = 0;
+    int valid = 1;
+    double seconds = 0;
+    unsigned int from;
+    for (from = 0; from < numBytes; from += blockSize, numBlocks++)
+    {
+      unsigned int to = from + blockSize < numBytes ? from + blockSize : numBytes;
+
+      unsigned int  litHistogram [DEFLATE_NUM_LITERALS];
+      unsigned int  distHistogram[DEFLATE_NUM_DISTANCES];
+      unsigned char litLengths   [DEFLATE_NUM_LITERALS];
+      unsigned char distLengths  [DEFLATE_NUM_DISTANCES];
+      deflateHistograms(data, from, to, head, litHistogram, distHistogram);
+
+      // a single distance symbol gets a 1-bit code (like zlib), no distance symbol at all => no code
+      unsigned int numDistances = 0;
+      for (i = 0; i < DEFLATE_NUM_DISTANCES; i++)
+        numDistances += distHistogram[i] > 0;
+      if (packageMerge(limitBits, DEFLATE_NUM_LITERALS, litHistogram, litLengths) == 0)
+      {
+        printf("BITS is too small (%d), no valid code possible\n", limitBits);
+        free(head);
+        return 3;
+      }
+      if (numDistances >= 2)
+      {
+        if (packageMerge(limitBits, DEFLATE_NUM_DISTANCES, distHistogram, distLengths) == 0)
+        {
+          printf("BITS is too small (%d), no valid code possible\n", limitBits);
+          free(head);
+          return 3;
+        }
+      }
+      else
+        for (i = 0; i < DEFLATE_NUM_DISTANCES; i++)
+          distLengths[i] = distHistogram[i] > 0;
+
+      unsigned long long bits = deflateDynamicBlockBits(litHistogram, litLengths, distHistogram, distLengths, packageMerge);
+      unsigned int litKraft  = deflateKraft(DEFLATE_NUM_LITERALS,  litLengths);
+      unsigned int distKraft = deflateKraft(DEFLATE_NUM_DISTANCES, distLengths);
+      before     += bits;
+      headerBits += deflateHeaderBits(litLengths, distLengths, packageMerge, NULL);
+
+      clock_t start = clock();
+      unsigned long long optimized = deflateOptimizeLengths(litHistogram, litLengths, distHistogram, distLengths, packageMerge);
+      seconds += (clock() - start) / (double) CLOCKS_PER_SEC;
+      after += optimized;
+
+      // same Kraft sums (=> still complete codes), no used symbol lost its code, reported size is correct and not larger than before
+      if (optimized == 0 || optimized > bits ||
+          optimized != deflateDynamicBlockBits(litHistogram, litLengths, distHistogram, distLengths, packageMerge) ||
+          deflateKraft(DEFLATE_NUM_LITERALS,  litLengths)  != litKraft ||
+          deflateKraft(DEFLATE_NUM_DISTANCES, distLengths) != distKraft)
+        valid = 0;
+      for (i = 0; i < DEFLATE_NUM_LITERALS; i++)
+        if ((litHistogram[i] > 0 && litLengths[i] == 0) || litLengths[i] > DEFLATE_MAX_LENGTH)
+          valid = 0;
+      for (i = 0; i < DEFLATE_NUM_DISTANCES; i++)
+        if ((distHistogram[i] > 0 && distLengths[i] == 0) || distLengths[i] > DEFLATE_MAX_LENGTH)
+          valid = 0;
+    }
+
+    printf("%5d byte blocks: %d blocks, headers are %.2f%% of %lld bits, optimized %lld bits (%.3f%% less, %.1f%% of the headers), %.1f us per block, check %s\n",
+           blockSize, numBlocks, 100.0 * headerBits / before, before, after, 100.0 * (before - after) / before,
+           100.0 * (before - after) / headerBits, 1e6 * seconds / numBlocks, valid ? "ok" : "FAILED");
+    if (!valid)
+      result = 3;
+  }
+
+  free(head);
+  return result;
+}
+
+// bzip2-style multiple tables settings
+#define MULTITABLE_SEGMENT    50
+#define MULTITABLE_MAXTABLES  6
+#define MULTITABLE_ITERATIONS 4
+#define MULTITABLE_THREADS    4
+
+// move-to-front transform of a file's bytes, then assign segments to 1 ... 6 tables
+// wall-clock time in seconds (clock() adds up the CPU time of all threads)
+static double wallClock()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int benchmarkMultiTable(unsigned char limitBits, const unsigned char* data, unsigned int numBytes)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  // move-to-front like bzip2 (but without BWT) to get skewed symbols
+  unsigned short* symbols = (unsigned short*) malloc(sizeof(unsigned short) * numBytes);
+  unsigned char mtf[MAXSYMBOLS];
+  for (i = 0; i < MAXSYMBOLS; i++)
+    mtf[i] = (unsigned char) i;
+  for (i = 0; i < numBytes; i++)
+  {
+    unsigned char current = data[i];
+    unsigned int pos = 0;
+    while (mtf[pos] != current)
+      pos++;
+    symbols[i] = (unsigned short) pos;
+    for (; pos > 0; pos--)
+      mtf[pos] = mtf[pos - 1];
+    mtf[0] = current;
+  }
+
+  unsigned int numSegments = (numBytes + MULTITABLE_SEGMENT - 1) / MULTITABLE_SEGMENT;
+  unsigned char* codeLengths         = (unsigned char*) malloc(MULTITABLE_MAXTABLES * MAXSYMBOLS);
+  unsigned char* selectors           = (unsigned char*) malloc(numSegments);
+  unsigned char* threadedCodeLengths = (unsigned char*) malloc(MULTITABLE_MAXTABLES * MAXSYMBOLS);
+  unsigned char* threadedSelectors   = (unsigned char*) malloc(numSegments);
+
+  printf("multiple tables: move-to-front, %d symbols per segment, %d iterations, packageMerge limited to %d bits\n",
+         MULTITABLE_SEGMENT, MULTITABLE_ITERATIONS, limitBits);
+
+  int result = 0;
+  unsigned long long single = 0;
+  unsigned int numTables;
+  for (numTables = 1; numTables <= MULTITABLE_MAXTABLES; numTables++)
+  {
+    double start = wallClock();
+    unsigned long long bits = multiTable(limitBits, MAXSYMBOLS, numBytes, symbols, MULTITABLE_SEGMENT, numTables, MULTITABLE_ITERATIONS,
+                                         packageMerge, 1, codeLengths, selectors);
+    double seconds = wallClock() - start;
+    if (bits == 0)
+    {
+      printf("BITS is too small (%d), no valid code possible\n", limitBits);
+      result = 3;
+      break;
+    }
+
+    // the number of threads must not change the result
+    start = wallClock();
+    unsigned long long threadedBits = multiTable(limitBits, MAXSYMBOLS, numBytes, symbols, MULTITABLE_SEGMENT, numTables, MULTITABLE_ITERATIONS,
+                                                 packageMerge, MULTITABLE_THREADS, threadedCodeLengths, threadedSelectors);
+    double threadedSeconds = wallClock() - start;
+    int same = threadedBits == bits;
+    for (i = 0; i < numTables * MAXSYMBOLS; i++)
+      if (threadedCodeLengths[i] != codeLengths[i])
+        same = 0;
+    for (i = 0; i < numSegments; i++)
+      if (threadedSelectors[i] != selectors[i])
+        same = 0;
+
+    // re-compute total size from selectors and code lengths
+    unsigned long long check = 0;
+    for (i = 0; i < numBytes; i++)
+      check += codeLengths[selectors[i / MULTITABLE_SEGMENT] * MAXSYMBOLS + symbols[i]];
+
+    if (numTables == 1)
+      single = bits;
+    printf("%d table%s: %lld bits (%.3f bits per symbol, %.2f%% less than a single table), %.2f ms, check %s, %d threads: %.2f ms, %s\n",
+           numTables, numTables == 1 ? " " : "s", bits, bits / (double) numBytes, 100.0 - 100.0 * bits / (double) single, seconds * 1000,
+           check == bits ? "ok" : "FAILED", MULTITABLE_THREADS, threadedSeconds * 1000, same ? "same" : "DIFFERENT");
+    if (check != bits || !same)
+      result = 3;
+  }
+
+  free(symbols);
+  free(codeLengths);
+  free(selectors);
+  free(threadedCodeLengths);
+  free(threadedSelectors);
+  return result;
+}
+
+// JPEG-like symbols: FILE's bytes are 8x8 blocks of samples, four luma blocks are followed by two chroma blocks (4:2:0)
+#define JPEG_BLOCK_SIZE 64
+// AC "coefficients" are differences of neighboring samples, divided by this quantizer
+#define JPEG_QUANTIZER   4
+// repeat jpegBuildStandardTables() to get more precise timing
+#define JPEG_REPEAT   1000
+#define JPEG_ROUNDS      5
+
+// number of bits of a DC difference or AC coefficient (JPEG's magnitude category)
+static unsigned char jpegCategory(int value)
+{
+  unsigned int magnitude = value < 0 ? -value : value;
+  unsigned char result = 0;
+  while (magnitude > 0)
+  {
+    magnitude >>= 1;
+    result++;
+  }
+  return result;
+}
+
+// DC luma, AC luma, DC chroma, AC chroma
+static void jpegHistograms(const unsigned char* data, unsigned int numBytes, unsigned int histograms[JPEG_NUM_TABLES][256])
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  unsigned int table;
+  for (table = 0; table < JPEG_NUM_TABLES; table++)
+    for (i = 0; i < 256; i++)
+      histograms[table][i] = 0;
+
+  // DC coefficients are stored as differences to the previous block of the same component
+  int previousDC[3] = { 0, 0, 0 };
+  unsigned int numBlocks = numBytes / JPEG_BLOCK_SIZE;
+  unsigned int block;
+  for (block = 0; block < numBlocks; block++)
+  {
+    const unsigned char* samples = data + block * JPEG_BLOCK_SIZE;
+    unsigned int component = block % 6 < 4 ? 0 : block % 6 - 3;
+    unsigned int* dc = histograms[component == 0 ? 0 : 2];
+    unsigned int* ac = histograms[component == 0 ? 1 : 3];
+
+    int sum = 0;
+    for (i = 0; i < JPEG_BLOCK_SIZE; i++)
+      sum += samples[i];
+    int average = sum / JPEG_BLOCK_SIZE;
+    dc[jpegCategory(average - previousDC[component])]++;
+    previousDC[component] = average;
+
+    // run-length of zeros (upper 4 bits) and category (lower 4 bits), ZRL = 16 zeros, EOB = only zeros left
+    unsigned int run = 0;
+    for (i = 1; i < JPEG_BLOCK_SIZE; i++)
+    {
+      int coefficient = (samples[i] - samples[i - 1]) / JPEG_QUANTIZER;
+      if (coefficient == 0)
+      {
+        run++;
+        continue;
+      }
+      for (; run >= 16; run -= 16)
+        ac[0xF0]++;
+      ac[(run << 4) | jpegCategory(coefficient)]++;
+      run = 0;
+    }
+    if (run > 0)
+      ac[0x00]++;
+  }
+}
+
+// verify BITS/HUFFVAL of a single table and compute the size of all symbols in bits, 0 if invalid
+static unsigned long long jpegCheckTable(const unsigned int histogram[256], const JpegHuffmanTable* table)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  // the all-ones code must be reserved: sum of 2^-length in units of 2^-16 must be less than 1
+  unsigned int kraft = 0, numSymbols = 0;
+  for (i = 0; i < JPEG_MAX_LENGTH; i++)
+  {
+    kraft      += table->bits[i] << (JPEG_MAX_LENGTH - (i + 1));
+    numSymbols += table->bits[i];
+  }
+  if (kraft >= (1U << JPEG_MAX_LENGTH) || numSymbols != table->numSymbols)
+    return 0;
+
+  // HUFFVAL covers each used symbol exactly once, sorted by code length and then by symbol
+  unsigned int numUsed = 0;
+  for (i = 0; i < 256; i++)
+    numUsed += histogram[i] > 0;
+  if (numSymbols != numUsed)
+    return 0;
+
+  unsigned char seen[256] = { 0 };
+  unsigned long long result = 0;
+  unsigned int pos = 0;
+  unsigned char length;
+  for (length = 1; length <= JPEG_MAX_LENGTH; length++)
+    for (i = 0; i < table->bits[length - 1]; i++, pos++)
+    {
+      unsigned char symbol = table->huffval[pos];
+      if (histogram[symbol] == 0 || seen[symbol] || (i > 0 && table->huffval[pos - 1] >= symbol))
+        return 0;
+      seen[symbol] = 1;
+      result += length * (unsigned long long) histogram[symbol];
+    }
+
+  return result;
+}
+
+// build JPEG tables for JPEG-like symbols of a file: verify them, compare to unrestricted codes and measure jpegBuildStandardTables
+static int benchmarkJpegTables(unsigned char limitBits, const unsigned char* data, unsigned int numBytes)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  if (limitBits != JPEG_MAX_LENGTH)
+  {
+    printf("BITS must be %d, baseline JPEG's code length limit\n", JPEG_MAX_LENGTH);
+    return 3;
+  }
+  if (numBytes < JPEG_BLOCK_SIZE)
+  {
+    printf("FILE needs at least %d bytes\n", JPEG_BLOCK_SIZE);
+    return 2;
+  }
+
+  printf("JPEG tables: %d byte blocks, AC quantizer %d, jpegBuildStandardTables\n", JPEG_BLOCK_SIZE, JPEG_QUANTIZER);
+
+  // the four tables of an image
+  unsigned int histograms[JPEG_NUM_TABLES][256];
+  jpegHistograms(data, numBytes, histograms);
+
+  // plus a Fibonacci-like histogram whose Huffman code is much longer than 16 bits
+  unsigned int skewed[256] = { 0 };
+  skewed[0] = skewed[1] = 1;
+  for (i = 2; i < 40; i++)
+    skewed[i] = skewed[i - 1] + skewed[i - 2];
+
+  JpegHuffmanTable tables[JPEG_NUM_TABLES + 1];
+  unsigned int numTables = jpegBuildStandardTables((const unsigned int (*)[256]) histograms, tables);
+  unsigned char maxSkewed = jpegBuildTable(256, skewed, &tables[JPEG_NUM_TABLES]);
+
+  int result = 0;
+  const char* names[JPEG_NUM_TABLES + 1] = { "DC luma  ", "AC luma  ", "DC chroma", "AC chroma", "Fibonacci" };
+  for (i = 0; i <= JPEG_NUM_TABLES; i++)
+  {
+    const unsigned int* histogram = i < JPEG_NUM_TABLES ? histograms[i] : skewed;
+    if (i < JPEG_NUM_TABLES && tables[i].numSymbols == 0)
+    {
+      printf("%s: empty\n", names[i]);
+      continue;
+    }
+
+    unsigned long long bits = jpegCheckTable(histogram, &tables[i]);
+
+    // optimal code lengths with the same limit but without reserving the all-ones code
+    unsigned char codeLengths[256];
+    packageMerge(JPEG_MAX_LENGTH, 256, histogram, codeLengths);
+    unsigned long long optimal = 0;
+    unsigned int j;
+    for (j = 0; j < 256; j++)
+      optimal += codeLengths[j] * (unsigned long long) histogram[j];
+
+    unsigned char maxLength = JPEG_MAX_LENGTH;
+    while (maxLength > 0 && tables[i].bits[maxLength - 1] == 0)
+      maxLength--;
+
+    printf("%s: %3d symbols, up to %2d bits, %lld bits (%.3f%% more than packageMerge without a reserved code), check %s\n",
+           names[i], tables[i].numSymbols, maxLength, bits, optimal > 0 ? 100.0 * bits / optimal - 100 : 0, bits > 0 ? "ok" : "FAILED");
+    if (bits == 0)
+      result = 3;
+  }
+  if (maxSkewed == 0 || maxSkewed > JPEG_MAX_LENGTH)
+    result = 3;
+
+  // DHT segment: marker, length and one class/id byte + BITS + HUFFVAL per non-empty table
+  unsigned char segment[4 + JPEG_NUM_TABLES * JPEG_MAX_DHT_TABLE];
+  unsigned int size = jpegWriteDht(JPEG_NUM_TABLES, tables, segment);
+  unsigned int expected = 4;
+  for (i = 0; i < JPEG_NUM_TABLES; i++)
+    if (tables[i].numSymbols > 0)
+      expected += 1 + JPEG_MAX_LENGTH + tables[i].numSymbols;
+  int dhtOk = size == expected && segment[0] == 0xFF && segment[1] == 0xC4 && ((unsigned int) segment[2] << 8 | segment[3]) == size - 2;
+  if (!dhtOk)
+    result = 3;
+
+  // best of a few rounds
+  double best = 0;
+  unsigned int round;
+  for (round = 0; round < JPEG_ROUNDS; round++)
+  {
+    double start = wallClock();
+    for (i = 0; i < JPEG_REPEAT; i++)
+      numTables = jpegBuildStandardTables((const unsigned int (*)[256]) histograms, tables);
+    double seconds = (wallClock() - start) / JPEG_REPEAT;
+    if (round == 0 || seconds < best)
+      best = seconds;
+  }
+
+  printf("DHT segment: %d bytes, check %s, jpegBuildStandardTables: %.1f us for %d tables\n",
+         size, dhtOk ? "ok" : "FAILED", best * 1e6, numTables);
+  return result;
+}
+
+// stream modes, return 0 if successful
+static int streamMode(char mode, unsigned char limitBits, const char* filename)
+{
+  unsigned int   numBytes;
+  unsigned char* data = readFile(filename, &numBytes);
+  if (data == NULL || numBytes == 0)
+  {
+    printf("can't read %s\n", filename);
+    free(data);
+    return 2;
+  }
+
+  int result = 2;
+  switch (mode)
+  {
+    case 'w': result = benchmarkSlidingWindow(limitBits, data, numBytes); break;
+    case 'b': result = benchmarkBlockSplit   (limitBits, data, numBytes); break;
+    case 'm': result = benchmarkMultiTable   (limitBits, data, numBytes); break;
+    case 'd': result = benchmarkDeflateHeader(limitBits, data, numBytes); break;
+    case 'j': result = benchmarkJpegTables   (limitBits, data, numBytes); break;
+    default:  printf("invalid mode -%c\n", mode); break;
+  }
+
+  free(data);
+  return result;
+}
+
 
 int main(int argc, char* argv[])
 {
+  // optional: hardware performance counters
+  int perfMode = argc > 1 && argv[1][0] == '-' && argv[1][1] == 'p' && argv[1][2] == 0;
+  if (perfMode)
+  {
+    // skip that parameter
+    argc--;
+    argv++;
+  }
+
+  // stream modes
+  if (!perfMode && argc == 4 && argv[1][0] == '-' && argv[1][1] != 0 && argv[1][2] == 0)
+  {
+    int limitBits = atoi(argv[2]);
+    if (limitBits <= 0 || limitBits > 63)
+      return 2;
+    return streamMode(argv[1][1], limitBits, argv[3]);
+  }
+
   // parse command-line
   if (argc < 3 || argc > 5)
   {
-    printf("syntax: ./benchmark ALGORITHM BITS [REPEAT] [HISTOGRAMFILE]\n"
-           " # ALGORITHM     => a number between 1 and 6: 1=Package-Merge, 2=MiniZ, 3=JPEG, 4=BZip2, 5=Kraft, 6=modified Kraft\n"
+    printf("syntax: ./benchmark [-p] ALGORITHM BITS [REPEAT] [HISTOGRAMFILE]\n"
+           "        ./benchmark -w|-b|-m|-d|-j BITS FILE\n"
+           " # -p            => show hardware performance counters (Linux only)\n"
+           " # ALGORITHM     => a number between 1 and 8: 1=Package-Merge, 2=MiniZ, 3=JPEG, 4=BZip2, 5=Kraft, 6=modified Kraft, 7=cached Package-Merge, 8=automatic\n"
+           "                    or unlimited Huffman codes: 0=Moffat, 0t=two-queue\n"
            " # BITS          => the upper code length limit\n"
            " # REPEAT        => repeat algorithm to get more precise timing, default=1000\n"
-           " # HISTOGRAMFILE => read pre-computed histogram from a file\n");
+           " # HISTOGRAMFILE => read pre-computed histogram from a file, multiple histograms switch to corpus mode\n"
+           " # -w            => adaptive code lengths of a sliding window over FILE's bytes\n"
+           " # -b            => split FILE's bytes into blocks with their own codes\n"
+           " # -m            => bzip2-style multiple tables for FILE's bytes (after move-to-front)\n"
+           " # -d            => DEFLATE blocks of FILE's bytes (simple LZ77): header size and deflateOptimizeLengths' gain\n"
+           " # -j            => JPEG tables for FILE's bytes (8x8 blocks, BITS must be 16): checks and timing of jpegBuildStandardTables\n");
     return 1;
   }
 
   // basic loop counter
-  int i;
+  unsigned int i;
 
   // algorithm's name
   const char* name = "???";
@@ -54,7 +848,9 @@ int main(int argc, char* argv[])
   if (repeat <= 0)
     repeat = 1000;
 
-  // histogram
+  // one or more histograms
+  unsigned int* histograms    = defaultHistogram;
+  unsigned int  numHistograms = 1;
   if (argc == 5)
   {
     // open file or STDIN
@@ -69,70 +865,94 @@ int main(int argc, char* argv[])
       return 2;
     }
 
-    // read the first 256 values
-    for (i = 0; i < MAXSYMBOLS; i++)
-      if (feof(handle) || fscanf(handle, "%u", &histogram[i]) != 1)
-        histogram[i] = 0;
+    // read blocks of 256 values until end of file
+    histograms    = NULL;
+    numHistograms = 0;
+    for (;;)
+    {
+      unsigned int current[MAXSYMBOLS];
+      // first value missing ? => end of file
+      if (fscanf(handle, "%u", &current[0]) != 1)
+        break;
+      for (i = 1; i < MAXSYMBOLS; i++)
+        if (feof(handle) || fscanf(handle, "%u", &current[i]) != 1)
+          current[i] = 0;
+
+      histograms = (unsigned int*) realloc(histograms, sizeof(unsigned int) * MAXSYMBOLS * (numHistograms + 1));
+      for (i = 0; i < MAXSYMBOLS; i++)
+        histograms[numHistograms * MAXSYMBOLS + i] = current[i];
+      numHistograms++;
+    }
 
     fclose(handle);
+
+    if (numHistograms == 0)
+    {
+      printf("no histogram found in %s\n", filename);
+      return 2;
+    }
   }
+  // more than one histogram ?
+  int corpusMode = numHistograms > 1;
 
   // parameters of length limiting algorithms
-  int numCodes = MAXSYMBOLS;
-  unsigned char codeLengths[MAXSYMBOLS];
-  unsigned char maxBits;
+  unsigned int   numCodes    = MAXSYMBOLS;
+  unsigned char* codeLengths = (unsigned char*) malloc(numHistograms * MAXSYMBOLS);
 
-  // choose an algorithm and run it repeatedly
+  // choose an algorithm
+  Algorithm function = NULL;
   int algorithm = argv[1][0] - '0';
+  // only algorithm 0 has variants
+  char variant = argv[1][1];
+  if (variant != 0 && (algorithm != 0 || variant != 't' || argv[1][2] != 0))
+  {
+    printf("invalid algorithm %s\n", argv[1]);
+    return 2;
+  }
   switch (algorithm)
   {
-    case 0:
-      name = "moffat (ignores bit limit)";
-      for (i = 0; i < repeat; i++)
-        maxBits = moffat      (           numCodes, histogram, codeLengths);
-      break;
-
-    case 1:
-      name = "packageMerge";
-      for (i = 0; i < repeat; i++)
-        maxBits = packageMerge(limitBits, numCodes, histogram, codeLengths);
-      break;
-
-    case 2:
-      name = "limitedMiniz";
-      for (i = 0; i < repeat; i++)
-        maxBits = limitedMiniz(limitBits, numCodes, histogram, codeLengths);
-      break;
-
-    case 3:
-      name = "limitedJpeg";
-      for (i = 0; i < repeat; i++)
-        maxBits = limitedJpeg(limitBits, numCodes, histogram, codeLengths);
-      break;
-
-    case 4:
-      name = "limitedBzip2";
-      for (i = 0; i < repeat; i++)
-        maxBits = limitedBzip2(limitBits, numCodes, histogram, codeLengths);
-      break;
-
-    case 5:
-      name = "limitedKraft";
-      for (i = 0; i < repeat; i++)
-        maxBits = limitedKraft(limitBits, numCodes, histogram, codeLengths);
-      break;
-
-    case 6:
-      name = "limitedKraftHeap";
-      for (i = 0; i < repeat; i++)
-        maxBits = limitedKraftHeap(limitBits, numCodes, histogram, codeLengths);
-      break;
+    case 0: if (variant == 't')
+            {
+              name = "two-queue (ignores bit limit)"; function = twoQueueIgnoreLimit;
+            }
+            else
+            {
+              name = "moffat (ignores bit limit)";    function = moffatIgnoreLimit;
+            }
+            break;
+    case 1: name = "packageMerge";               function = packageMerge;       break;
+    case 2: name = "limitedMiniz";               function = limitedMiniz;       break;
+    case 3: name = "limitedJpeg";                function = limitedJpeg;        break;
+    case 4: name = "limitedBzip2";               function = limitedBzip2;       break;
+    case 5: name = "limitedKraft";               function = limitedKraft;       break;
+    case 6: name = "limitedKraftHeap";           function = limitedKraftHeap;   break;
+    case 7: name = "packageMerge with cache";    function = cachedPackageMerge;
+            cache = codeCacheCreate(1024, CACHE_TOLERANCE);
+            break;
+    case 8: name = "limitedAuto";                function = autoSelect;         break;
 
     default:
       printf("invalid algorithm %d\n", algorithm);
       return 2;
   }
 
+  // prepare hardware performance counters
+  PerfCounters counters;
+  if (perfMode && perfCountersOpen(&counters) == 0)
+    printf("no hardware performance counters available (not Linux ? check /proc/sys/kernel/perf_event_paranoid)\n");
+
+  // and run it repeatedly
+  lengthLimitStatsReset();
+  clock_t start = clock();
+  if (perfMode)
+    perfCountersStart(&counters);
+  unsigned char maxBits = run(function, limitBits, repeat, numHistograms, histograms, codeLengths);
+  if (perfMode)
+    perfCountersStop(&counters);
+  double seconds = (clock() - start) / (double) CLOCKS_PER_SEC;
+  // only if compiled with LENGTHLIMIT_STATS
+  LengthLimitStats stats = lengthLimitStatsGet();
+
   // failed ?
   if (maxBits == 0)
   {
@@ -142,35 +962,125 @@ int main(int argc, char* argv[])
 
   // count total size of encoded data (without overhead of Huffman tables)
   unsigned long long original   = 0;
-  unsigned long long compressed = 0;
-  for (i = 0; i < numCodes; i++)
-  {
-    original   +=       8        * histogram[i]; // one byte per symbol
-    compressed += codeLengths[i] * histogram[i];
-  }
+  unsigned long long compressed = totalBits(numHistograms, histograms, codeLengths);
+  for (i = 0; i < numHistograms * MAXSYMBOLS; i++)
+    original += 8 * (unsigned long long) histograms[i]; // one byte per symbol
 
   // compression ratio
   double percentage = 100.0 * compressed / (double) original;
 
   // check Kraft value (must not be greater than 1.0)
-  unsigned long long one = 1ULL << maxBits;
-  unsigned long long sum = 0;
-  unsigned int  numUsedCodes = 0;
-  for (i = 0; i < numCodes; i++)
-    if (codeLengths[i] > 0)
-    {
-      sum += one >> codeLengths[i];
-      numUsedCodes++;
-    }
-  double kraft = sum / (double) one;
+  double kraft = 0;
+  unsigned int numUsedCodes = 0;
+  unsigned int current;
+  for (current = 0; current < numHistograms; current++)
+  {
+    unsigned long long one = 1ULL << maxBits;
+    unsigned long long sum = 0;
+    for (i = 0; i < numCodes; i++)
+      if (codeLengths[current * MAXSYMBOLS + i] > 0)
+      {
+        sum += one >> codeLengths[current * MAXSYMBOLS + i];
+        numUsedCodes++;
+      }
+
+    // keep worst Kraft value
+    if (kraft < sum / (double) one)
+      kraft = sum / (double) one;
+  }
 
   // output
   printf("algorithm: %s\n", name);
-  printf("%d symbols, %d are used at least once\n", numCodes, numUsedCodes);
+  if (corpusMode)
+    printf("%d histograms with %d symbols each, %.1f are used on average\n", numHistograms, numCodes, numUsedCodes / (double) numHistograms);
+  else
+    printf("%d symbols, %d are used at least once\n", numCodes, numUsedCodes);
   printf("limit to %d bits (max. %d bits actually produced)\n", limitBits, maxBits);
   printf("%lld => %lld bits (%.2f%%)\n", original, compressed, percentage);
+  // DEFLATE's literals can't exceed 15 bits
+  if (maxBits <= DEFLATE_MAX_LENGTH && numCodes <= 256)
+  {
+    unsigned long long headers = totalHeaderBits(numHistograms, numCodes, codeLengths);
+    printf("with DEFLATE headers: %lld bits (%.2f%%), %.1f header bits per histogram\n",
+           compressed + headers, 100.0 * (compressed + headers) / (double) original, headers / (double) numHistograms);
+  }
   printf("check Kraft sum: %s (%.6f)\n", kraft <= 1 ? "ok" : "FAILED", kraft);
   printf("repeat %dx\n", repeat);
+  if (perfMode)
+  {
+    double numCalls = (double) repeat * numHistograms;
+    const unsigned long long* values = counters.values;
+    if (counters.available[PERF_CYCLES])
+      printf("perf: %.0f cycles per call\n", values[PERF_CYCLES] / numCalls);
+    if (counters.available[PERF_CYCLES] && counters.available[PERF_INSTRUCTIONS] && values[PERF_CYCLES] > 0)
+      printf("perf: %.0f instructions per call, IPC %.2f\n", values[PERF_INSTRUCTIONS] / numCalls, values[PERF_INSTRUCTIONS] / (double) values[PERF_CYCLES]);
+    if (counters.available[PERF_BRANCHES] && counters.available[PERF_BRANCH_MISSES] && values[PERF_BRANCHES] > 0)
+      printf("perf: %.0f branches per call, %.2f%% mispredicted (%.1f per call)\n", values[PERF_BRANCHES] / numCalls,
+             100.0 * values[PERF_BRANCH_MISSES] / values[PERF_BRANCHES], values[PERF_BRANCH_MISSES] / numCalls);
+    if (counters.available[PERF_L1D_MISSES])
+      printf("perf: %.1f L1d read misses per call\n", values[PERF_L1D_MISSES] / numCalls);
+    perfCountersClose(&counters);
+  }
+  if (lengthLimitStatsEnabled())
+  {
+    double numCalls = (double) repeat * numHistograms;
+    printf("stats per call: %.2f iterations, %.2f heap operations, %.2f Moffat calls, %.0f bytes allocated\n",
+           stats.iterations / numCalls, stats.heapOperations / numCalls, stats.moffatCalls / numCalls, stats.bytesAllocated / numCalls);
+    if (stats.earlyExits > 0)
+      printf("stats early exit: %.1f%% of all calls, on average at level %.2f\n",
+             100.0 * stats.earlyExits / numCalls, stats.earlyExitLevels / (double) stats.earlyExits);
+  }
+  if (corpusMode)
+  {
+    printf("time: %.3f s (%.3f us per histogram)\n", seconds, 1e6 * seconds / ((double) repeat * numHistograms));
+
+    // how often would unlimited Huffman codes be short enough ?
+    unsigned int numFits = 0, numGuaranteed = 0;
+    unsigned char unlimited[MAXSYMBOLS];
+    for (current = 0; current < numHistograms; current++)
+    {
+      const unsigned int* currentHistogram = histograms + current * MAXSYMBOLS;
+      if (moffat(numCodes, currentHistogram, unlimited) <= limitBits)
+        numFits++;
+
+      unsigned long long sumHistogram = 0;
+      unsigned int       minHistogram = 0;
+      for (i = 0; i < numCodes; i++)
+      {
+        sumHistogram += currentHistogram[i];
+        if (currentHistogram[i] > 0 && (minHistogram > currentHistogram[i] || minHistogram == 0))
+          minHistogram = currentHistogram[i];
+      }
+      if (moffatFitsLength(limitBits, sumHistogram, minHistogram))
+        numGuaranteed++;
+    }
+    printf("no length-limiting needed: %d histograms (%.1f%%), %d (%.1f%%) detected by the cheap Fibonacci test\n",
+           numFits, 100.0 * numFits / numHistograms, numGuaranteed, 100.0 * numGuaranteed / numHistograms);
+  }
+
+  // compare cache to plain package-merge
+  if (cache != NULL)
+  {
+    unsigned long long hits, misses;
+    codeCacheStats(cache, &hits, &misses);
+    printf("cache: %lld hits, %lld misses (hit rate %.2f%%)\n", hits, misses, 100.0 * hits / (double)(hits + misses));
+
+    // same again without cache
+    start = clock();
+    run(packageMerge, limitBits, repeat, numHistograms, histograms, codeLengths);
+    double uncached = (clock() - start) / (double) CLOCKS_PER_SEC;
+    unsigned long long optimal = totalBits(numHistograms, histograms, codeLengths);
+
+    printf("without cache: %.3f s, %lld bits => cache saved %.3f s (%.2f%%) and lost %lld bits (%.4f%%)\n",
+           uncached, optimal, uncached - seconds, 100 * (uncached - seconds) / uncached,
+           compressed - optimal, 100.0 * (compressed - optimal) / (double) optimal);
+
+    codeCacheFree(cache);
+  }
+
+  if (histograms != defaultHistogram)
+    free(histograms);
+  free(codeLengths);
 
   return 0;
 }
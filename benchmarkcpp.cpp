@@ -0,0 +1,295 @@
+// //////////////////////////////////////////////////////////
+// benchmarkcpp.cpp
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+// make liblengthlimit.a && g++ -std=c++20 -O3 benchmarkcpp.cpp liblengthlimit.a -o benchmarkcpp -pthread
+
+#include "lengthlimiter.hpp"
+#include "constexprcodes.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm> // std::sort
+
+// DEFLATE's code length alphabet
+#define NUMCODES   19
+#define MAXLENGTH   7
+// histograms of bytes
+#define MAXSYMBOLS 256
+
+// histogram of first 64k of enwik dataset (same as benchmark.c)
+static constexpr unsigned int enwikHistogram[MAXSYMBOLS] = { 0,0,0,0,0,0,0,0,0,0,538,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,8289,6,72,31,0,1,309,509,57,58,58,0,448,278,565,490,150,215,94,61,57,71,47,53,87,123,195,345,294,151,293,12,0,275,85,153,50,97,76,64,56,134,40,33,66,113,58,33,116,5,98,147,172,33,17,84,3,11,19,1172,0,1173,0,35,0,4125,472,1866,1424,4746,918,776,2091,4112,73,308,1796,1593,3528,3514,1109,177,3069,3334,4336,1288,513,535,179,670,58,64,171,64,3,0,6,0,5,2,5,3,0,0,2,1,3,0,2,0,0,0,4,0,0,1,2,2,1,2,4,2,0,2,1,1,0,1,4,1,3,0,1,1,2,2,1,15,2,2,0,2,0,2,4,1,2,7,2,0,0,4,17,2,3,1,3,3,0,1,0,0,0,25,2,1,0,0,0,0,0,0,0,0,0,0,19,7,0,0,0,0,0,7,10,6,0,1,0,0,0,0,14,0,3,5,2,1,2,0,0,0,0,1,2,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
+// a static code for that histogram, computed by the compiler
+static constexpr CanonicalCode<MAXSYMBOLS> enwikCode = makeCanonicalCode<11>(enwikHistogram);
+static_assert(enwikCode.maxLength == 11, "length limit not reached");
+
+
+// same interface as all length-limiting algorithms
+typedef unsigned char (*Algorithm)(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+// same interface as LengthLimiter::run()
+typedef unsigned char (*FixedAlgorithm)(const unsigned int histogram[], unsigned char codeLengths[]);
+
+
+// run-length encode code lengths like DEFLATE and count each symbol of the code length alphabet
+static void codeLengthHistogram(unsigned int numCodes, const unsigned char codeLengths[], unsigned int histogram[NUMCODES])
+{
+  unsigned int i;
+  for (i = 0; i < NUMCODES; i++)
+    histogram[i] = 0;
+
+  i = 0;
+  while (i < numCodes)
+  {
+    // find length of the current run
+    unsigned char length = codeLengths[i];
+    unsigned int  run    = 1;
+    while (i + run < numCodes && codeLengths[i + run] == length)
+      run++;
+    i += run;
+
+    if (length == 0)
+    {
+      // 18 => 11 to 138 zeros
+      for (; run >= 11; run -= run < 138 ? run : 138)
+        histogram[18]++;
+      // 17 => 3 to 10 zeros
+      if (run >= 3)
+      {
+        histogram[17]++;
+        run = 0;
+      }
+    }
+    else
+    {
+      // first code length must be stored explicitly
+      histogram[length]++;
+      run--;
+      // 16 => repeat previous code length 3 to 6 times
+      for (; run >= 3; run -= run < 6 ? run : 6)
+        histogram[16]++;
+    }
+
+    // remaining code lengths are stored explicitly
+    histogram[length] += run;
+  }
+}
+
+
+// run an algorithm for each histogram, repeat multiple times, return total size of encoded data (0 if any call failed)
+static unsigned long long runGeneric(Algorithm algorithm, unsigned char limitBits, unsigned int numCodes, int repeat,
+                                     unsigned int numHistograms, const unsigned int* histograms, double* seconds)
+{
+  unsigned char codeLengths[MAXSYMBOLS];
+  unsigned long long result = 0;
+
+  clock_t start = clock();
+  int i;
+  for (i = 0; i < repeat; i++)
+  {
+    result = 0;
+    unsigned int current;
+    for (current = 0; current < numHistograms; current++)
+    {
+      const unsigned int* histogram = histograms + current * numCodes;
+      if (algorithm(limitBits, numCodes, histogram, codeLengths) == 0)
+        return 0;
+
+      unsigned int j;
+      for (j = 0; j < numCodes; j++)
+        result += codeLengths[j] * (unsigned long long) histogram[j];
+    }
+  }
+  *seconds = (clock() - start) / (double) CLOCKS_PER_SEC;
+
+  return result;
+}
+
+// same for LengthLimiter
+static unsigned long long runFixed(FixedAlgorithm algorithm, unsigned int numCodes, int repeat,
+                                   unsigned int numHistograms, const unsigned int* histograms, double* seconds)
+{
+  unsigned char codeLengths[MAXSYMBOLS];
+  unsigned long long result = 0;
+
+  clock_t start = clock();
+  int i;
+  for (i = 0; i < repeat; i++)
+  {
+    result = 0;
+    unsigned int current;
+    for (current = 0; current < numHistograms; current++)
+    {
+      const unsigned int* histogram = histograms + current * numCodes;
+      if (algorithm(histogram, codeLengths) == 0)
+        return 0;
+
+      unsigned int j;
+      for (j = 0; j < numCodes; j++)
+        result += codeLengths[j] * (unsigned long long) histogram[j];
+    }
+  }
+  *seconds = (clock() - start) / (double) CLOCKS_PER_SEC;
+
+  return result;
+}
+
+// constexpr reference copy (evaluated at runtime) must produce the same code lengths as packageMergeSortedInPlace(), returns number of mismatches
+static unsigned int verifyConstexpr(unsigned int numCodes, unsigned int numHistograms, const unsigned int* histograms)
+{
+  unsigned int numMismatches = 0;
+  unsigned int current;
+  for (current = 0; current < numHistograms; current++)
+  {
+    // sort ascendingly and remove zeros
+    const unsigned int* histogram = histograms + current * numCodes;
+    unsigned int sorted[MAXSYMBOLS];
+    unsigned int numNonZero = 0;
+    unsigned int i;
+    for (i = 0; i < numCodes; i++)
+      if (histogram[i] > 0)
+        sorted[numNonZero++] = histogram[i];
+    std::sort(sorted, sorted + numNonZero);
+
+    // several limits, including some which are too small
+    unsigned char maxBits = numCodes == NUMCODES ? MAXLENGTH : 15;
+    unsigned char limitBits;
+    for (limitBits = maxBits - 7; limitBits <= maxBits; limitBits++)
+    {
+      unsigned int runtime[MAXSYMBOLS], compileTime[MAXSYMBOLS];
+      for (i = 0; i < numNonZero; i++)
+        runtime[i] = compileTime[i] = sorted[i];
+
+      unsigned char maxRuntime     = packageMergeSortedInPlace                     (limitBits, numNonZero, runtime);
+      unsigned char maxCompileTime = packageMergeSortedInPlaceConstexpr<MAXSYMBOLS>(limitBits, numNonZero, compileTime);
+
+      bool same = maxRuntime == maxCompileTime;
+      for (i = 0; i < numNonZero && same; i++)
+        same = runtime[i] == compileTime[i];
+      if (!same)
+        numMismatches++;
+    }
+  }
+  return numMismatches;
+}
+
+
+// compare generic C code and LengthLimiter
+static void compare(const char* name, Algorithm generic, FixedAlgorithm fixed, unsigned char limitBits, unsigned int numCodes, int repeat,
+                    unsigned int numHistograms, const unsigned int* histograms)
+{
+  double secondsGeneric, secondsFixed;
+  unsigned long long bitsGeneric = runGeneric(generic, limitBits, numCodes, repeat, numHistograms, histograms, &secondsGeneric);
+  unsigned long long bitsFixed   = runFixed  (fixed,              numCodes, repeat, numHistograms, histograms, &secondsFixed);
+
+  double perCall = 1e9 / ((double) repeat * numHistograms);
+  printf("%-13s %3d symbols, %2d bits: generic %8.1f ns, fixed %8.1f ns => %.2fx faster, %s\n",
+         name, numCodes, limitBits, secondsGeneric * perCall, secondsFixed * perCall,
+         secondsFixed > 0 ? secondsGeneric / secondsFixed : 0,
+         bitsGeneric == bitsFixed && bitsGeneric > 0 ? "same size" : "DIFFERENT SIZE");
+}
+
+
+int main(int argc, char* argv[])
+{
+  // parse command-line
+  if (argc < 2 || argc > 3)
+  {
+    printf("syntax: ./benchmarkcpp HISTOGRAMFILE [REPEAT]\n"
+           " # HISTOGRAMFILE => pre-computed histograms of bytes (see histogram.c),\n"
+           "                    their DEFLATE code lengths are run-length encoded to get histograms of the code length alphabet\n"
+           " # REPEAT        => repeat algorithm to get more precise timing, default=100\n");
+    return 1;
+  }
+
+  // basic loop counter
+  unsigned int i;
+
+  // more accurate timing if repeating (default: 100)
+  int repeat = argc >= 3 ? atoi(argv[2]) : 0;
+  if (repeat <= 0)
+    repeat = 100;
+
+  // open file or STDIN
+  FILE* handle = stdin;
+  const char* filename = argv[1];
+  if (filename[0] != '-' || filename[1] != 0)
+    handle = fopen(filename, "rb");
+
+  if (!handle)
+  {
+    printf("can't open histogram %s\n", filename);
+    return 2;
+  }
+
+  // read blocks of 256 values until end of file
+  unsigned int* histograms    = NULL;
+  unsigned int  numHistograms = 0;
+  for (;;)
+  {
+    unsigned int current[MAXSYMBOLS];
+    // first value missing ? => end of file
+    if (fscanf(handle, "%u", &current[0]) != 1)
+      break;
+    for (i = 1; i < MAXSYMBOLS; i++)
+      if (feof(handle) || fscanf(handle, "%u", &current[i]) != 1)
+        current[i] = 0;
+
+    histograms = (unsigned int*) realloc(histograms, sizeof(unsigned int) * MAXSYMBOLS * (numHistograms + 1));
+    for (i = 0; i < MAXSYMBOLS; i++)
+      histograms[numHistograms * MAXSYMBOLS + i] = current[i];
+    numHistograms++;
+  }
+
+  fclose(handle);
+
+  if (numHistograms == 0)
+  {
+    printf("no histogram found in %s\n", filename);
+    return 2;
+  }
+
+  // code lengths of each histogram => histograms of the code length alphabet
+  unsigned int* small = (unsigned int*) malloc(sizeof(unsigned int) * NUMCODES * numHistograms);
+  unsigned int current;
+  for (current = 0; current < numHistograms; current++)
+  {
+    unsigned char codeLengths[MAXSYMBOLS];
+    packageMerge(15, MAXSYMBOLS, histograms + current * MAXSYMBOLS, codeLengths);
+    codeLengthHistogram(MAXSYMBOLS, codeLengths, small + current * NUMCODES);
+  }
+
+  // compile-time code must be as good as package-merge at runtime
+  unsigned char codeLengths[MAXSYMBOLS];
+  packageMerge(11, MAXSYMBOLS, enwikHistogram, codeLengths);
+  unsigned long long bitsRuntime = 0, bitsCompileTime = 0;
+  for (i = 0; i < MAXSYMBOLS; i++)
+  {
+    bitsRuntime     += codeLengths[i]           * (unsigned long long) enwikHistogram[i];
+    bitsCompileTime += enwikCode.codeLengths[i] * (unsigned long long) enwikHistogram[i];
+  }
+  printf("compile-time code for enwik, 11 bits: %lld bits, packageMerge at runtime: %lld bits => %s\n",
+         bitsCompileTime, bitsRuntime, bitsCompileTime == bitsRuntime ? "same size" : "DIFFERENT SIZE");
+
+  // frozen constexpr copy vs current C code
+  unsigned int numMismatches = verifyConstexpr(MAXSYMBOLS, numHistograms, histograms) + verifyConstexpr(NUMCODES, numHistograms, small);
+  printf("constexpr package-merge vs packageMerge: %s (%d mismatches)\n", numMismatches == 0 ? "same code lengths" : "DIFFERENT CODE LENGTHS", numMismatches);
+
+  printf("%d histograms, repeat %dx\n", numHistograms, repeat);
+
+  compare("packageMerge", packageMerge, LengthLimiter<NUMCODES, MAXLENGTH, LimitPackageMerge>::run, MAXLENGTH, NUMCODES, repeat, numHistograms, small);
+  compare("limitedMiniz", limitedMiniz, LengthLimiter<NUMCODES, MAXLENGTH, LimitMiniz       >::run, MAXLENGTH, NUMCODES, repeat, numHistograms, small);
+  compare("limitedJpeg",  limitedJpeg,  LengthLimiter<NUMCODES, MAXLENGTH, LimitJpeg        >::run, MAXLENGTH, NUMCODES, repeat, numHistograms, small);
+  compare("limitedBzip2", limitedBzip2, LengthLimiter<NUMCODES, MAXLENGTH, LimitBzip2       >::run, MAXLENGTH, NUMCODES, repeat, numHistograms, small);
+
+  compare("packageMerge", packageMerge, LengthLimiter<MAXSYMBOLS, 15, LimitPackageMerge>::run, 15, MAXSYMBOLS, repeat, numHistograms, histograms);
+  compare("limitedMiniz", limitedMiniz, LengthLimiter<MAXSYMBOLS, 15, LimitMiniz       >::run, 15, MAXSYMBOLS, repeat, numHistograms, histograms);
+  compare("limitedJpeg",  limitedJpeg,  LengthLimiter<MAXSYMBOLS, 15, LimitJpeg        >::run, 15, MAXSYMBOLS, repeat, numHistograms, histograms);
+  compare("limitedBzip2", limitedBzip2, LengthLimiter<MAXSYMBOLS, 15, LimitBzip2       >::run, 15, MAXSYMBOLS, repeat, numHistograms, histograms);
+
+  free(small);
+  free(histograms);
+
+  return numMismatches == 0 ? 0 : 3;
+}
@@ -0,0 +1,339 @@
+// //////////////////////////////////////////////////////////
+// blocksplit.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "blocksplit.h"
+#include "packagemerge.h"     // packageMerge
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
+#include <stdlib.h> // malloc/free
+#include <stdint.h> // int32_t
+
+
+/// evaluate that many evenly spaced split points per block with the cheap estimate
+#define NUM_CANDIDATES 64
+/// and refine the best of them with exact code lengths
+#define NUM_FINALISTS   3
+/// marker for code lengths which couldn't be computed
+#define INVALID_BITS   (~0ULL)
+
+
+/// a block and its best split point
+typedef struct
+{
+  /// first symbol
+  unsigned int       begin;
+  /// one past the last symbol
+  unsigned int       end;
+  /// exact size (without overhead)
+  unsigned long long bits;
+  /// best split point, 0 if splitting doesn't pay off
+  unsigned int       splitAt;
+  /// exact size of the left  part if split at splitAt
+  unsigned long long bitsLeft;
+  /// exact size of the right part if split at splitAt
+  unsigned long long bitsRight;
+} Block;
+
+/// parameters and temporary buffers
+typedef struct
+{
+  unsigned char         maxLength;
+  unsigned int          numCodes;
+  const unsigned short* symbols;
+  unsigned int          minBlockSize;
+  unsigned int          blockOverhead;
+  BlockSplitAlgorithm   algorithm;
+
+  /// incremental histograms left and right of a split point
+  unsigned int*         left;
+  unsigned int*         right;
+  /// histogram and code lengths for exact costs
+  unsigned int*         histogram;
+  unsigned char*        codeLengths;
+} Context;
+
+
+// compute log(x), based on limitedkraftheap.c's fastlog2 (but "version B": quadratic, zero error at 1, 1.5 and 2)
+static float fastlog2(float x)
+{
+  // see https://www.flipcode.com/archives/Fast_log_Function.shtml
+  union
+  {
+    float f;
+    int32_t i;
+  } alias = { x };
+
+  // integer part: exponent without its bias
+  float result = ((alias.i >> 23) & 255) - 127;
+  // replace exponent by zero => mantissa between 1 and 2
+  alias.i &= ~(255 << 23);
+  alias.i +=   127 << 23;
+
+  return result + (alias.f * -0.33985f + 2.01955f) * alias.f - 1.6797f;
+}
+
+
+/// cheap estimate: rounded entropy of each symbol
+/** @param  maxLength    maximum code length
+ *  @param  numCodes     number of codes
+ *  @param  histogram    how often each code/symbol was found
+ *  @param  sumHistogram sum of all counts
+ *  @result approximate size in bits
+ */
+static unsigned long long estimateBits(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned int sumHistogram)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  float invSumHistogram = 1.0f / sumHistogram;
+
+  unsigned long long result = 0;
+  for (i = 0; i < numCodes; i++)
+  {
+    if (histogram[i] == 0)
+      continue;
+
+    // theoretical number of bits, rounded to the next integer
+    float entropy = -fastlog2(histogram[i] * invSumHistogram);
+    unsigned char rounded = (unsigned char)(entropy + 0.5f);
+    if (rounded == 0)
+      rounded = 1;
+    if (rounded > maxLength)
+      rounded = maxLength;
+
+    result += histogram[i] * (unsigned long long) rounded;
+  }
+
+  return result;
+}
+
+
+/// exact size of symbols[begin] to symbols[end - 1] based on the selected algorithm
+static unsigned long long exactBits(Context* context, unsigned int begin, unsigned int end)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  for (i = 0; i < context->numCodes; i++)
+    context->histogram[i] = 0;
+  for (i = begin; i < end; i++)
+    context->histogram[context->symbols[i]]++;
+
+  // a single symbol still needs one bit
+  unsigned int numUsed = 0;
+  for (i = 0; i < context->numCodes && numUsed < 2; i++)
+    if (context->histogram[i] > 0)
+      numUsed++;
+  if (numUsed == 1)
+    return end - begin;
+
+  if (context->algorithm(context->maxLength, context->numCodes, context->histogram, context->codeLengths) == 0)
+    return INVALID_BITS;
+
+  unsigned long long result = 0;
+  for (i = 0; i < context->numCodes; i++)
+    result += context->histogram[i] * (unsigned long long) context->codeLengths[i];
+  return result;
+}
+
+
+/// find the best split point of a block
+static void findSplit(Context* context, Block* block)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  block->splitAt = 0;
+
+  unsigned int begin = block->begin;
+  unsigned int end   = block->end;
+  if (end - begin < 2 * context->minBlockSize || block->bits == INVALID_BITS)
+    return;
+
+  // all symbols are right of the first split point
+  for (i = 0; i < context->numCodes; i++)
+  {
+    context->left [i] = 0;
+    context->right[i] = 0;
+  }
+  for (i = begin; i < end; i++)
+    context->right[context->symbols[i]]++;
+
+  // evenly spaced split points, but respect minimum block size
+  unsigned int step = (end - begin) / NUM_CANDIDATES;
+  if (step == 0)
+    step = 1;
+
+  // the best candidates according to the estimate, sorted by their estimate
+  unsigned int       finalists[NUM_FINALISTS];
+  unsigned long long estimates[NUM_FINALISTS];
+  unsigned int numFinalists = 0;
+
+  unsigned int pos = begin;
+  unsigned int candidate;
+  for (candidate = begin + context->minBlockSize; candidate <= end - context->minBlockSize; candidate += step)
+  {
+    // incremental histograms: move symbols from right to left
+    for (; pos < candidate; pos++)
+    {
+      unsigned short symbol = context->symbols[pos];
+      context->left [symbol]++;
+      context->right[symbol]--;
+    }
+
+    unsigned long long estimate = estimateBits(context->maxLength, context->numCodes, context->left,  candidate - begin) +
+                                  estimateBits(context->maxLength, context->numCodes, context->right, end - candidate);
+
+    // insertion sort, drop the worst if full
+    if (numFinalists == NUM_FINALISTS && estimate >= estimates[NUM_FINALISTS - 1])
+      continue;
+    if (numFinalists < NUM_FINALISTS)
+      numFinalists++;
+    i = numFinalists - 1;
+    for (; i > 0 && estimates[i - 1] > estimate; i--)
+    {
+      finalists[i] = finalists[i - 1];
+      estimates[i] = estimates[i - 1];
+    }
+    finalists[i] = candidate;
+    estimates[i] = estimate;
+  }
+
+  // exact costs of the finalists, split only if both blocks (including their overhead) are smaller than one block
+  unsigned long long best = block->bits;
+  for (i = 0; i < numFinalists; i++)
+  {
+    unsigned long long bitsLeft  = exactBits(context, begin,        finalists[i]);
+    unsigned long long bitsRight = exactBits(context, finalists[i], end);
+    if (bitsLeft == INVALID_BITS || bitsRight == INVALID_BITS)
+      continue;
+
+    unsigned long long total = bitsLeft + bitsRight + context->blockOverhead;
+    if (total < best)
+    {
+      best             = total;
+      block->splitAt   = finalists[i];
+      block->bitsLeft  = bitsLeft;
+      block->bitsRight = bitsRight;
+    }
+  }
+}
+
+
+/// split a stream of symbols into blocks
+/** @param  maxLength     maximum code length, e.g. 15 for DEFLATE
+ *  @param  numCodes      number of codes (alphabet size), all symbols must be smaller
+ *  @param  numSymbols    number of symbols in the stream
+ *  @param  symbols       the stream
+ *  @param  minBlockSize  minimum number of symbols per block (except if the whole stream is shorter)
+ *  @param  blockOverhead cost of each block's code table in bits
+ *  @param  maxBlocks     maximum number of blocks (size of blockStarts)
+ *  @param  algorithm     length-limiting algorithm for exact costs, NULL => packageMerge
+ *  @param  blockStarts   [out] index of each block's first symbol, blockStarts[0] is always 0
+ *  @param  totalBits     [out] exact size of all blocks including their overhead, may be NULL
+ *  @result number of blocks, 0 if error
+ */
+unsigned int blockSplit(unsigned char maxLength, unsigned int numCodes, unsigned int numSymbols, const unsigned short symbols[],
+                        unsigned int minBlockSize, unsigned int blockOverhead, unsigned int maxBlocks,
+                        BlockSplitAlgorithm algorithm, unsigned int blockStarts[], unsigned long long* totalBits)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  if (numSymbols == 0 || numCodes == 0 || maxBlocks == 0)
+    return 0;
+  for (i = 0; i < numSymbols; i++)
+    if (symbols[i] >= numCodes)
+      return 0;
+
+  if (algorithm == NULL)
+    algorithm = packageMerge;
+  if (minBlockSize == 0)
+    minBlockSize = 1;
+
+  Context context;
+  context.maxLength     = maxLength;
+  context.numCodes      = numCodes;
+  context.symbols       = symbols;
+  context.minBlockSize  = minBlockSize;
+  context.blockOverhead = blockOverhead;
+  context.algorithm     = algorithm;
+  context.left          = (unsigned int*)  malloc(3 * numCodes * sizeof(unsigned int));
+  context.right         = context.left  + numCodes;
+  context.histogram     = context.right + numCodes;
+  context.codeLengths   = (unsigned char*) malloc(numCodes);
+  Block* blocks         = (Block*)         malloc(maxBlocks * sizeof(Block));
+  LENGTHLIMIT_COUNT(bytesAllocated, 3 * numCodes * sizeof(unsigned int) + numCodes + maxBlocks * sizeof(Block));
+
+  // start with a single block
+  blocks[0].begin = 0;
+  blocks[0].end   = numSymbols;
+  blocks[0].bits  = exactBits(&context, 0, numSymbols);
+  unsigned int numBlocks = 0;
+  if (blocks[0].bits != INVALID_BITS)
+  {
+    numBlocks = 1;
+    if (maxBlocks > 1)
+      findSplit(&context, &blocks[0]);
+  }
+
+  // best-first: split the block with the largest gain
+  while (numBlocks > 0 && numBlocks < maxBlocks)
+  {
+    LENGTHLIMIT_COUNT(iterations, 1);
+
+    unsigned int       best     = numBlocks;
+    unsigned long long bestGain = 0;
+    for (i = 0; i < numBlocks; i++)
+      if (blocks[i].splitAt > 0)
+      {
+        unsigned long long gain = blocks[i].bits - (blocks[i].bitsLeft + blocks[i].bitsRight + blockOverhead);
+        if (gain > bestGain)
+        {
+          best     = i;
+          bestGain = gain;
+        }
+      }
+    // no split pays off anymore
+    if (best == numBlocks)
+      break;
+
+    // make room for the right half
+    for (i = numBlocks; i > best + 1; i--)
+      blocks[i] = blocks[i - 1];
+    numBlocks++;
+
+    Block* left  = &blocks[best];
+    Block* right = &blocks[best + 1];
+    right->begin = left->splitAt;
+    right->end   = left->end;
+    right->bits  = left->bitsRight;
+    left ->end   = left->splitAt;
+    left ->bits  = left->bitsLeft;
+
+    // no need to look for more split points if there's no room left
+    left ->splitAt = 0;
+    right->splitAt = 0;
+    if (numBlocks < maxBlocks)
+    {
+      findSplit(&context, left);
+      findSplit(&context, right);
+    }
+  }
+
+  unsigned long long sumBits = 0;
+  for (i = 0; i < numBlocks; i++)
+  {
+    blockStarts[i] = blocks[i].begin;
+    sumBits       += blocks[i].bits + blockOverhead;
+  }
+  if (totalBits != NULL)
+    *totalBits = sumBits;
+
+  free(blocks);
+  free(context.codeLengths);
+  free(context.left);
+
+  return numBlocks;
+}
@@ -0,0 +1,46 @@
+// //////////////////////////////////////////////////////////
+// blocksplit.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// split a stream of symbols into blocks, each of them gets its own prefix code
+// - the block with the highest gain is split first (best-first), until no split pays off or maxBlocks is reached
+// - candidate split points are evaluated with incremental histograms and a cheap estimate:
+//   rounded entropy of each symbol (like limitedKraftHeap's first step, but without fixing the Kraft sum)
+// - only the best candidates are evaluated exactly by a length-limiting algorithm (default: packageMerge)
+// - each block costs blockOverhead bits (its code table), e.g. about 500 bits for DEFLATE's dynamic blocks
+// - example:
+//   unsigned int blockStarts[64];
+//   unsigned int numBlocks = blockSplit(15, 286, numSymbols, symbols, 1024, 500, 64, NULL, blockStarts, NULL);
+//   for (i = 0; i < numBlocks; i++)
+//     ... block i consists of symbols[blockStarts[i]] to symbols[(i + 1 < numBlocks ? blockStarts[i + 1] : numSymbols) - 1]
+
+/// same interface as all length-limiting algorithms, e.g. packageMerge or limitedKraftHeap
+typedef unsigned char (*BlockSplitAlgorithm)(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+/// split a stream of symbols into blocks
+/** @param  maxLength     maximum code length, e.g. 15 for DEFLATE
+ *  @param  numCodes      number of codes (alphabet size), all symbols must be smaller
+ *  @param  numSymbols    number of symbols in the stream
+ *  @param  symbols       the stream
+ *  @param  minBlockSize  minimum number of symbols per block (except if the whole stream is shorter)
+ *  @param  blockOverhead cost of each block's code table in bits
+ *  @param  maxBlocks     maximum number of blocks (size of blockStarts)
+ *  @param  algorithm     length-limiting algorithm for exact costs, NULL => packageMerge
+ *  @param  blockStarts   [out] index of each block's first symbol, blockStarts[0] is always 0
+ *  @param  totalBits     [out] exact size of all blocks including their overhead, may be NULL
+ *  @result number of blocks, 0 if error
+ */
+unsigned int blockSplit(unsigned char maxLength, unsigned int numCodes, unsigned int numSymbols, const unsigned short symbols[],
+                        unsigned int minBlockSize, unsigned int blockOverhead, unsigned int maxBlocks,
+                        BlockSplitAlgorithm algorithm, unsigned int blockStarts[], unsigned long long* totalBits);
+
+#ifdef __cplusplus
+}
+#endif
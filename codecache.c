@@ -0,0 +1,368 @@
+// //////////////////////////////////////////////////////////
+// codecache.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "codecache.h"
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
+#include <stdlib.h>  // malloc/free
+#include <string.h>  // memcmp/memcpy
+#include <stdint.h>  // uint64_t
+#include <pthread.h> // pthread_mutex_*
+
+
+// each fingerprint entry covers 1/CODECACHE_QUANTIZATION bits of a symbol's theoretical code length
+// (higher values => more precise fingerprints => fewer hits but better matches)
+// - 1 had as many hits as 2 for the benchmark's corpus (all of them duplicate blocks, no loss)
+//   and 774 instead of 678 hits for 779 blocks of a log file (16k each, 0.0006% loss)
+// - 0 (only "symbol is used or not") caused more slot collisions and lost 0.02% for the corpus
+#define CODECACHE_QUANTIZATION 1
+
+// fingerprints of alphabets up to that size are computed on the stack, larger ones need a malloc
+#define CODECACHE_MAX_STACK 4096
+
+
+// ----- local helper function -----
+
+// compute log2(x) for x > 0 with an error below 1e-10, no need for math.h / link -lm
+// (fastlog2 from limitedkraft.c is off by up to 0.003 bits, too much for a tolerance of 0.1%)
+static double accuratelog2(double x)
+{
+  // map double and int to the same 64 bit memory location
+  union
+  {
+    double   d;
+    uint64_t i;
+  } alias = { x };
+
+  // get exponent, its bias is 1023
+  int exponent = (int)((alias.i >> 52) & 0x7FF) - 1023;
+
+  // set exponent to 0 so that we get a number m between 1 and 2
+  alias.i &= ~(0x7FFULL << 52);
+  alias.i |=   1023ULL  << 52;
+  double m = alias.d;
+
+  // move m to [sqrt(0.5), sqrt(2)) for faster convergence
+  if (m > 1.4142135623730951)
+  {
+    m *= 0.5;
+    exponent++;
+  }
+
+  // ln(m) = 2 * atanh(s) = 2 * (s + s^3/3 + s^5/5 + ...) where s = (m - 1) / (m + 1) and |s| < 0.172
+  double s  = (m - 1) / (m + 1);
+  double s2 = s * s;
+  double ln = 2 * s * (1 + s2 * (1.0/3 + s2 * (1.0/5 + s2 * (1.0/7 + s2 * (1.0/9 + s2 * (1.0/11))))));
+
+  // 1/ln(2) = 1.4426950408889634
+  return exponent + ln * 1.4426950408889634;
+}
+
+
+// ----- cache data structures -----
+
+/// a single cached set of code lengths
+typedef struct
+{
+  /// hash of the fingerprint, 0 means "slot is empty"
+  unsigned int   hash;
+  /// same as the parameters of the length-limiting algorithm
+  CodeCacheAlgorithm algorithm;
+  unsigned char  maxLength;
+  unsigned int   numCodes;
+  /// result of the length-limiting algorithm, 0 while the code lengths are still being computed
+  unsigned char  maxBits;
+  /// incremented whenever a thread claims the slot for a new fingerprint
+  unsigned int   generation;
+  /// cost of the code lengths divided by entropy of the histogram they were computed for (>= 1)
+  double         redundancy;
+  /// quantized log2 of each symbol's probability, 0 if unused
+  unsigned char* fingerprint;
+  /// computed code lengths
+  unsigned char* codeLengths;
+} CacheSlot;
+
+/// the cache is a simple direct-mapped hash table
+struct CodeCache
+{
+  CacheSlot*         slots;
+  /// number of slots minus one (number of slots is a power of two)
+  unsigned int       mask;
+  /// accept cached code lengths if at most that much worse
+  double             tolerance;
+  /// statistics
+  unsigned long long hits;
+  unsigned long long misses;
+  /// protects slots and statistics
+  pthread_mutex_t    lock;
+};
+
+
+/// claim a slot for a new fingerprint, its code lengths are invalid until they are computed (caller must hold the lock)
+/** @result generation of the slot, the code lengths may only be stored if it didn't change in the meantime */
+static unsigned int claimSlot(CacheSlot* slot, unsigned int hash, CodeCacheAlgorithm algorithm, unsigned char maxLength, unsigned int numCodes,
+                              const unsigned char print[])
+{
+  if (slot->numCodes != numCodes)
+  {
+    free(slot->fingerprint);
+    free(slot->codeLengths);
+    slot->fingerprint = (unsigned char*) malloc(numCodes);
+    slot->codeLengths = (unsigned char*) malloc(numCodes);
+    LENGTHLIMIT_COUNT(bytesAllocated, 2 * numCodes);
+  }
+  slot->hash      = hash;
+  slot->algorithm = algorithm;
+  slot->maxLength = maxLength;
+  slot->numCodes  = numCodes;
+  slot->maxBits   = 0;
+  slot->generation++;
+  memcpy(slot->fingerprint, print, numCodes);
+
+  return slot->generation;
+}
+
+
+/// compute fingerprint of a histogram and its entropy (in bits), return its hash
+static unsigned int fingerprint(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[],
+                                unsigned char result[], double* entropy)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  // total number of symbols
+  unsigned long long sumHistogram = 0;
+  for (i = 0; i < numCodes; i++)
+    sumHistogram += histogram[i];
+
+  // 1/sumHistogram is needed multiple times, let's replace division by multiplication
+  double invSumHistogram = 1.0 / sumHistogram;
+
+  // FNV-1a hash, see http://www.isthe.com/chongo/tech/comp/fnv/
+  unsigned int hash = 2166136261U;
+  hash = (hash ^ maxLength) * 16777619U;
+
+  *entropy = 0;
+  for (i = 0; i < numCodes; i++)
+  {
+    unsigned char quantized = 0;
+    if (histogram[i] > 0)
+    {
+      // theoretical number of bits
+      double bits = -accuratelog2(histogram[i] * invSumHistogram);
+      *entropy += bits * histogram[i];
+
+      // all rare symbols end up with the longest code length anyway
+      // => don't distinguish them, otherwise the cache would hardly ever hit
+      if (bits > maxLength)
+        bits = maxLength;
+
+      // quantize, 0 is reserved for unused symbols
+      double scaled = bits * CODECACHE_QUANTIZATION + 1.5;
+      quantized = scaled >= 255 ? 255 : (unsigned char) scaled;
+    }
+
+    result[i] = quantized;
+    hash = (hash ^ quantized) * 16777619U;
+  }
+
+  // avoid zero, it's reserved for empty slots
+  return hash != 0 ? hash : 1;
+}
+
+
+// ----- and now externally visible code -----
+
+
+/// allocate an empty cache
+/** @param  numSlots  maximum number of cached code lengths, will be rounded up to the next power of two
+ *  @param  tolerance accept cached code lengths if they are at most that much worse
+ *                    than they were for their original histogram, e.g. 0.001 = 0.1%
+ *  @result handle, NULL if error
+ */
+CodeCache* codeCacheCreate(unsigned int numSlots, double tolerance)
+{
+  if (numSlots == 0 || tolerance < 0)
+    return NULL;
+
+  // round up to the next power of two
+  unsigned int size = 1;
+  while (size < numSlots)
+    size <<= 1;
+
+  CodeCache* cache = (CodeCache*) malloc(sizeof(CodeCache));
+  cache->slots     = (CacheSlot*) malloc(sizeof(CacheSlot) * size);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(CodeCache) + sizeof(CacheSlot) * size);
+  cache->mask      = size - 1;
+  cache->tolerance = tolerance;
+  cache->hits      = 0;
+  cache->misses    = 0;
+
+  // all slots are empty
+  unsigned int i;
+  for (i = 0; i < size; i++)
+  {
+    cache->slots[i].hash        = 0;
+    cache->slots[i].numCodes    = 0;
+    cache->slots[i].generation  = 0;
+    cache->slots[i].fingerprint = NULL;
+    cache->slots[i].codeLengths = NULL;
+  }
+
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+
+/// release memory
+void codeCacheFree(CodeCache* cache)
+{
+  if (cache == NULL)
+    return;
+
+  unsigned int i;
+  for (i = 0; i <= cache->mask; i++)
+  {
+    free(cache->slots[i].fingerprint);
+    free(cache->slots[i].codeLengths);
+  }
+  free(cache->slots);
+
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+
+/// remove all cached code lengths and reset statistics
+void codeCacheClear(CodeCache* cache)
+{
+  pthread_mutex_lock(&cache->lock);
+
+  // keep memory, it's probably needed again
+  unsigned int i;
+  for (i = 0; i <= cache->mask; i++)
+    cache->slots[i].hash = 0;
+
+  cache->hits   = 0;
+  cache->misses = 0;
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+
+/// return cached code lengths if possible, else run the algorithm and update the cache
+/** - same parameters as all length-limiting algorithms plus the cache and the algorithm itself
+ *  @param  cache      handle
+ *  @param  algorithm  length-limiting algorithm, e.g. packageMerge
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram  how often each code/symbol was found
+ *  @param  codeLength [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char codeCacheLookup(CodeCache* cache, CodeCacheAlgorithm algorithm, unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+{
+  if (numCodes == 0)
+    return 0;
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  // fingerprint of the current histogram, computed without holding the lock
+  unsigned char  stackPrint[CODECACHE_MAX_STACK];
+  unsigned char* print = stackPrint;
+  if (numCodes > CODECACHE_MAX_STACK)
+  {
+    print = (unsigned char*) malloc(numCodes);
+    LENGTHLIMIT_COUNT(bytesAllocated, numCodes);
+  }
+  double entropy;
+  unsigned int hash = fingerprint(maxLength, numCodes, histogram, print, &entropy);
+
+  // ----- look up -----
+  CacheSlot* slot = &cache->slots[hash & cache->mask];
+
+  pthread_mutex_lock(&cache->lock);
+
+  int found = slot->hash      == hash      &&
+              slot->algorithm == algorithm &&
+              slot->maxLength == maxLength &&
+              slot->numCodes  == numCodes  &&
+              slot->maxBits   != 0         &&
+              memcmp(slot->fingerprint, print, numCodes) == 0;
+
+  unsigned char maxBits    = 0;
+  double        redundancy = 0;
+  if (found)
+  {
+    // copy while still locked, another thread might overwrite the slot
+    memcpy(codeLengths, slot->codeLengths, numCodes);
+    maxBits    = slot->maxBits;
+    redundancy = slot->redundancy;
+    pthread_mutex_unlock(&cache->lock);
+
+    // cost of the cached code lengths for the current histogram
+    // same fingerprint => exactly the same symbols are used, each of them has a valid code length
+    unsigned long long cost = 0;
+    for (i = 0; i < numCodes; i++)
+      cost += codeLengths[i] * (unsigned long long) histogram[i];
+
+    // as good as for their original histogram ? (plus some tolerance)
+    // note: a single symbol has zero entropy, its fingerprint is always a perfect match
+    int accept = cost <= entropy * redundancy * (1 + cache->tolerance) || entropy == 0;
+
+    pthread_mutex_lock(&cache->lock);
+    if (accept)
+    {
+      cache->hits++;
+      pthread_mutex_unlock(&cache->lock);
+      if (print != stackPrint)
+        free(print);
+      return maxBits;
+    }
+  }
+
+  // claim the slot for the current fingerprint (still locked)
+  cache->misses++;
+  unsigned int generation = claimSlot(slot, hash, algorithm, maxLength, numCodes, print);
+
+  pthread_mutex_unlock(&cache->lock);
+
+  if (print != stackPrint)
+    free(print);
+
+  // ----- compute and store -----
+  maxBits = algorithm(maxLength, numCodes, histogram, codeLengths);
+  if (maxBits == 0)
+    return 0;
+
+  unsigned long long cost = 0;
+  for (i = 0; i < numCodes; i++)
+    cost += codeLengths[i] * (unsigned long long) histogram[i];
+  redundancy = entropy > 0 ? cost / entropy : 1;
+
+  pthread_mutex_lock(&cache->lock);
+
+  // unless another thread claimed the slot in the meantime
+  if (slot->generation == generation)
+  {
+    slot->maxBits    = maxBits;
+    slot->redundancy = redundancy;
+    memcpy(slot->codeLengths, codeLengths, numCodes);
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  return maxBits;
+}
+
+
+/// number of cache hits and misses since codeCacheCreate() or codeCacheClear()
+void codeCacheStats(CodeCache* cache, unsigned long long* hits, unsigned long long* misses)
+{
+  pthread_mutex_lock(&cache->lock);
+  *hits   = cache->hits;
+  *misses = cache->misses;
+  pthread_mutex_unlock(&cache->lock);
+}
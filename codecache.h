@@ -0,0 +1,62 @@
+// //////////////////////////////////////////////////////////
+// codecache.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// many data blocks have near-identical statistics and recomputing their code lengths is a waste of time
+// - a histogram is reduced to a "fingerprint": the quantized log2 of each symbol's probability
+// - histograms with the same fingerprint share the same cache slot
+// - cached code lengths are only re-used if they are almost as good as the code lengths
+//   they were originally computed for (relative to the entropy of each histogram)
+// - otherwise code lengths are computed and the slot is overwritten
+// - all functions are thread-safe (based on a pthread mutex which is only held while probing, copying and claiming a slot)
+// - example:
+//   CodeCache* cache = codeCacheCreate(1024, 0.001);
+//   for (i = 0; i < numBlocks; i++)
+//     codeCacheLookup(cache, packageMerge, 15, 256, histogram[i], codeLengths[i]);
+//   codeCacheFree(cache);
+
+/// same interface as all length-limiting algorithms, e.g. packageMerge or limitedKraftHeap
+typedef unsigned char (*CodeCacheAlgorithm)(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+/// opaque handle
+typedef struct CodeCache CodeCache;
+
+/// allocate an empty cache
+/** @param  numSlots  maximum number of cached code lengths, will be rounded up to the next power of two
+ *  @param  tolerance accept cached code lengths if they are at most that much worse
+ *                    than they were for their original histogram, e.g. 0.001 = 0.1%
+ *  @result handle, NULL if error
+ */
+CodeCache* codeCacheCreate(unsigned int numSlots, double tolerance);
+
+/// release memory
+void codeCacheFree(CodeCache* cache);
+
+/// remove all cached code lengths and reset statistics
+void codeCacheClear(CodeCache* cache);
+
+/// return cached code lengths if possible, else run the algorithm and update the cache
+/** - same parameters as all length-limiting algorithms plus the cache and the algorithm itself
+ *  @param  cache      handle
+ *  @param  algorithm  length-limiting algorithm, e.g. packageMerge
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram  how often each code/symbol was found
+ *  @param  codeLength [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char codeCacheLookup(CodeCache* cache, CodeCacheAlgorithm algorithm, unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+/// number of cache hits and misses since codeCacheCreate() or codeCacheClear()
+void codeCacheStats(CodeCache* cache, unsigned long long* hits, unsigned long long* misses);
+
+#ifdef __cplusplus
+}
+#endif
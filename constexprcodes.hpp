@@ -0,0 +1,373 @@
+// //////////////////////////////////////////////////////////
+// constexprcodes.hpp
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+// requires C++20 (constexpr functions may modify local arrays and may be evaluated by the compiler)
+
+// static formats (e.g. DEFLATE's fixed Huffman codes) often embed pre-computed code tables
+// - these tables can be computed during compilation with zero startup cost
+// - the functions in this file are allocation-free copies of moffatSortedInPlace and packageMergeSortedInPlace
+//   which can be evaluated at compile time as well as at runtime
+// - FROZEN REFERENCE COPIES: they follow the straightforward algorithm (one 64 bit mask per package, bit by bit backtracking)
+//   and deliberately don't track the optimizations of packagemerge.c / moffat.c (bitsets, popcount backtracking, branchless merging, ...)
+//   => code lengths must nevertheless be identical, ./benchmarkcpp compares them with packageMerge() for each histogram of its input file
+// - the buffers needed by package-merge are local arrays, their size is a template parameter
+// - example:
+//   constexpr unsigned int histogram[4] = { 5, 0, 1, 2 };
+//   constexpr auto code = makeCanonicalCode<15>(histogram);
+//   static_assert(code.maxLength == 2, "");
+//   => code.codeLengths = { 1, 0, 2, 2 } and code.codes = { 0, 0, 2, 3 } (binary: 0, -, 10, 11)
+
+
+/// same result as moffatSortedInPlace() in moffat.c (frozen reference copy, see top of file)
+/** - histogram must be in ascending order and no entry must be zero
+ *  @param  numCodes number of elements
+ *  @param  A [in]   how often each code/symbol was found [out] computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+constexpr unsigned char moffatSortedInPlaceConstexpr(unsigned int numCodes, unsigned int A[])
+{
+  // handle two pathological cases
+  if (numCodes == 0)
+    return 0;
+  if (numCodes == 1)
+  {
+    A[0] = 1;
+    return 1;
+  }
+
+  // phase 1
+  unsigned int leaf = 0;
+  unsigned int root = 0;
+  for (unsigned int next = 0; next < numCodes - 1; next++)
+  {
+    // first child (assign to A[next])
+    if (leaf >= numCodes || (root < next && A[root] < A[leaf]))
+    {
+      A[next] = A[root];
+      A[root] = next;
+      root++;
+    }
+    else
+    {
+      A[next] = A[leaf];
+      leaf++;
+    }
+
+    // second child (add to A[next])
+    if (leaf >= numCodes || (root < next && A[root] < A[leaf]))
+    {
+      A[next] += A[root];
+      A[root] = next;
+      root++;
+    }
+    else
+    {
+      A[next] += A[leaf];
+      leaf++;
+    }
+  }
+
+  // phase 2
+  A[numCodes - 2] = 0;
+  for (int j = (int)numCodes - 3; j >= 0; j--)
+    A[j] = A[A[j]] + 1;
+
+  // phase 3
+  unsigned int  avail = 1;
+  unsigned int  used  = 0;
+  unsigned char depth = 0;
+
+  int root2 = (int)numCodes - 2;
+  unsigned int next = numCodes - 1;
+  while (avail > 0)
+  {
+    while (root2 >= 0 && A[root2] == depth)
+    {
+      used++;
+      root2--;
+    }
+    while (avail > used)
+    {
+      A[next] = depth;
+      next--;
+      avail--;
+    }
+
+    avail = 2 * used;
+    depth++;
+    used = 0;
+  }
+
+  // code length is in descending order, thus the first element is the longest
+  return (unsigned char)A[0];
+}
+
+
+/// same result as packageMergeSortedInPlace() in packagemerge.c but without any heap allocations (frozen reference copy, see top of file)
+/** - histogram must be in ascending order and no entry must be zero
+ *  - MaxCodes is the size of the internal buffers, numCodes must not exceed it
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of A
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+template <unsigned int MaxCodes>
+constexpr unsigned char packageMergeSortedInPlaceConstexpr(unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+{
+  // one bit per level (hence at most 63 levels) and 64 bit weights, no matter how small the histogram is
+  typedef unsigned long long BitMask;
+  typedef unsigned long long HistItem;
+
+  // at least one code needs to be in use
+  if (numCodes == 0 || numCodes > MaxCodes || maxLength == 0 || maxLength > 63)
+    return 0;
+
+  // one or two codes are always encoded with a single bit
+  if (numCodes <= 2)
+  {
+    A[0] = 1;
+    if (numCodes == 2)
+      A[1] = 1;
+    return 1;
+  }
+
+  // at least log2(numCodes) bits required for every valid prefix code
+  if ((1ULL << maxLength) < numCodes)
+    return 0;
+
+  // fast path: if unlimited Huffman codes are short enough then they are optimal, too
+  unsigned int unlimited[MaxCodes] = {};
+  for (unsigned int i = 0; i < numCodes; i++)
+    unlimited[i] = A[i];
+  if (moffatSortedInPlaceConstexpr(numCodes, unlimited) <= maxLength)
+  {
+    for (unsigned int i = 0; i < numCodes; i++)
+      A[i] = unlimited[i];
+    return (unsigned char)A[0];
+  }
+
+  // A[] is an input  parameter (stores the histogram) as well as
+  //        an output parameter (stores the code lengths)
+  // => keep a copy of the histogram (instead of unlimited's code lengths)
+  unsigned int* histogram = unlimited;
+  for (unsigned int i = 0; i < numCodes; i++)
+    histogram[i] = A[i];
+  unsigned int* codeLengths = A;
+
+  // two buffers to process iterations and an array of bitmasks
+  HistItem bufferA [2 * MaxCodes] = {};
+  HistItem bufferB [2 * MaxCodes] = {};
+  BitMask  isMerged[2 * MaxCodes] = {};
+  HistItem* current  = bufferA;
+  HistItem* previous = bufferB;
+
+  // initial value of "previous" is a plain copy of the sorted histogram
+  for (unsigned int i = 0; i < numCodes; i++)
+    previous[i] = histogram[i];
+  unsigned int numPrevious = numCodes;
+
+  // the last 2 packages are irrelevant
+  unsigned int numRelevant = 2 * numCodes - 2;
+
+  // step 1: iterate through potential bit lengths while packaging and merging pairs
+  BitMask mask = 1;
+  for (unsigned char bits = maxLength - 1; bits > 0; bits--)
+  {
+    // ignore last element if numPrevious is odd (can't be paired)
+    numPrevious &= ~1U;
+
+    // first merged package
+    current[0] = histogram[0];
+    current[1] = histogram[1];
+    HistItem sum = current[0] + current[1];
+
+    // copy histogram and insert merged sums whenever possible
+    unsigned int numCurrent = 2;
+    unsigned int numHist    = numCurrent;
+    unsigned int numMerged  = 0;
+    for (;;)
+    {
+      // the next package isn't better than the next histogram item ?
+      if (numHist < numCodes && histogram[numHist] <= sum)
+      {
+        current[numCurrent++] = histogram[numHist++];
+        continue;
+      }
+
+      // store package
+      isMerged[numCurrent] |= mask;
+      current [numCurrent]  = sum;
+      numCurrent++;
+
+      // already finished last package ?
+      numMerged++;
+      if (numMerged * 2 >= numPrevious)
+        break;
+
+      // precompute next sum
+      sum = previous[numMerged * 2] + previous[numMerged * 2 + 1];
+    }
+
+    // make sure every code from the histogram is included
+    while (numHist < numCodes)
+      current[numCurrent++] = histogram[numHist++];
+
+    // prepare next mask
+    mask <<= 1;
+
+    // abort as soon as "previous" and "current" are identical
+    if (numPrevious >= numRelevant)
+    {
+      bool keepGoing = false;
+      for (unsigned int i = numRelevant - 1; i > 0; i--)
+        if (previous[i] != current[i])
+        {
+          keepGoing = true;
+          break;
+        }
+
+      if (!keepGoing)
+        break;
+    }
+
+    // swap pointers "previous" and "current"
+    HistItem* tmp = previous;
+    previous = current;
+    current  = tmp;
+
+    numPrevious = numCurrent;
+  }
+
+  // shifted one bit too far
+  mask >>= 1;
+
+  // step 2: tracking all merges will produce the code lengths
+  for (unsigned int i = 0; i < numCodes; i++)
+    codeLengths[i] = 0;
+
+  unsigned int numAnalyze = numRelevant;
+  while (mask != 0)
+  {
+    unsigned int numMerged = 0;
+
+    // the first two elements must be symbols, they can't be packages
+    codeLengths[0]++;
+    codeLengths[1]++;
+    unsigned int symbol = 2;
+
+    for (unsigned int i = symbol; i < numAnalyze; i++)
+      if ((isMerged[i] & mask) == 0)
+      {
+        codeLengths[symbol]++;
+        symbol++;
+      }
+      else
+        numMerged++;
+
+    numAnalyze = 2 * numMerged;
+    mask >>= 1;
+  }
+
+  // last iteration can't have any merges
+  for (unsigned int i = 0; i < numAnalyze; i++)
+    codeLengths[i]++;
+
+  // first symbol has the longest code because it's the least frequent in the sorted histogram
+  return (unsigned char)codeLengths[0];
+}
+
+
+// ---------- canonical codes ----------
+
+/// code lengths and canonical codes of an alphabet with NumCodes symbols
+template <unsigned int NumCodes>
+struct CanonicalCode
+{
+  /// longest code length, 0 if error
+  unsigned char maxLength;
+  /// code length of each symbol, 0 if unused
+  unsigned char codeLengths[NumCodes];
+  /// canonical code of each symbol (its lowest codeLengths[x] bits, most significant bit first), 0 if unused
+  unsigned int  codes[NumCodes];
+};
+
+
+/// assign canonical codes to code lengths, the same way as DEFLATE (RFC 1951 section 3.2.2)
+/** - shorter codes are numerically smaller than longer codes
+ *  - codes of the same length are assigned in ascending order of their symbols
+ */
+template <unsigned int NumCodes>
+constexpr void assignCanonicalCodes(CanonicalCode<NumCodes>& code)
+{
+  // count codes per length
+  unsigned int histNumBits[64] = {};
+  for (unsigned int i = 0; i < NumCodes; i++)
+    histNumBits[code.codeLengths[i]]++;
+  histNumBits[0] = 0;
+
+  // smallest code of each length
+  unsigned int nextCode[64] = {};
+  unsigned int value = 0;
+  for (unsigned int bits = 1; bits < 64; bits++)
+  {
+    value = (value + histNumBits[bits - 1]) << 1;
+    nextCode[bits] = value;
+  }
+
+  for (unsigned int i = 0; i < NumCodes; i++)
+    code.codes[i] = code.codeLengths[i] > 0 ? nextCode[code.codeLengths[i]]++ : 0;
+}
+
+
+/// compute optimal length-limited code lengths (package-merge) and their canonical codes, can be evaluated at compile time
+/** - histogram can be in any order and may contain zeros
+ *  @param  histogram  how often each code/symbol was found
+ *  @result code lengths and canonical codes, maxLength is 0 if error
+ */
+template <unsigned char MaxLength, unsigned int NumCodes>
+constexpr CanonicalCode<NumCodes> makeCanonicalCode(const unsigned int (&histogram)[NumCodes])
+{
+  static_assert(MaxLength > 0 && MaxLength <= 32, "length limit must be between 1 and 32 bits");
+
+  CanonicalCode<NumCodes> result = {};
+
+  // upper 32 bits: count, lower 32 bits: symbol (same as LengthLimiter in lengthlimiter.hpp)
+  unsigned long long mapping[NumCodes] = {};
+  unsigned int numNonZero = 0;
+  for (unsigned int i = 0; i < NumCodes; i++)
+    if (histogram[i] != 0)
+      mapping[numNonZero++] = ((unsigned long long)histogram[i] << 32) | i;
+
+  if (numNonZero == 0)
+    return result;
+
+  // insertion sort, it's only evaluated once
+  for (unsigned int i = 1; i < numNonZero; i++)
+  {
+    unsigned long long current = mapping[i];
+    unsigned int j = i;
+    for (; j > 0 && mapping[j - 1] > current; j--)
+      mapping[j] = mapping[j - 1];
+    mapping[j] = current;
+  }
+
+  // extract ascendingly ordered histogram
+  unsigned int sorted[NumCodes] = {};
+  for (unsigned int i = 0; i < numNonZero; i++)
+    sorted[i] = (unsigned int)(mapping[i] >> 32);
+
+  result.maxLength = packageMergeSortedInPlaceConstexpr<NumCodes>(MaxLength, numNonZero, sorted);
+  if (result.maxLength == 0)
+    return result;
+
+  // restore original order
+  for (unsigned int i = 0; i < numNonZero; i++)
+    result.codeLengths[(unsigned int)mapping[i]] = (unsigned char)sorted[i];
+
+  assignCanonicalCodes(result);
+  return result;
+}
@@ -0,0 +1,584 @@
+// //////////////////////////////////////////////////////////
+// deflateheader.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "deflateheader.h"
+
+#include "packagemerge.h" // packageMerge
+
+
+
+
+#include <stddef.h>       // NULL
+
+
+/// code lengths of the code length code are stored in this order (RFC 1951, section 3.2.7)
+static const unsigned char codeLengthOrder[DEFLATE_NUM_CODELENGTH] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+/// extra bits of the code length code's symbols 16, 17 and 18
+static const unsigned char codeLengthExtraBits[DEFLATE_NUM_CODELENGTH] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 2, 3, 7 };
+
+/// extra bits of the length symbols 257 to 285
+static const unsigned char lengthExtraBits[DEFLATE_NUM_LITERALS - 257] =
+  { 0,0,0,0,0,0,0,0, 1,1,1,1, 2,2,2,2, 3,3,3,3, 4,4,4,4, 5,5,5,5, 0 };
+/// extra bits of the distance symbols 0 to 29
+static const unsigned char distanceExtraBits[DEFLATE_NUM_DISTANCES] =
+  { 0,0,0,0, 1,1, 2,2, 3,3, 4,4, 5,5, 6,6, 7,7, 8,8, 9,9, 10,10, 11,11, 12,12, 13,13 };
+
+
+/// run-length encode code lengths like DEFLATE and count each symbol of the code length alphabet
+static void countCodeLengthSymbols(unsigned int numCodes, const unsigned char codeLengths[], unsigned int histogram[DEFLATE_NUM_CODELENGTH])
+{
+  unsigned int i = 0;
+  while (i < numCodes)
+  {
+    // find length of the current run
+    unsigned char length = codeLengths[i];
+    unsigned int  run    = 1;
+    while (i + run < numCodes && codeLengths[i + run] == length)
+      run++;
+    i += run;
+
+    if (length == 0)
+    {
+      // 18 => 11 to 138 zeros
+      for (; run >= 11; run -= run < 138 ? run : 138)
+        histogram[18]++;
+      // 17 => 3 to 10 zeros
+      if (run >= 3)
+      {
+        histogram[17]++;
+        run = 0;
+      }
+    }
+    else
+    {
+      // first code length must be stored explicitly
+      histogram[length]++;
+      run--;
+      // 16 => repeat previous code length 3 to 6 times
+      for (; run >= 3; run -= run < 6 ? run : 6)
+        histogram[16]++;
+    }
+
+    // remaining code lengths are stored explicitly
+    histogram[length] += run;
+  }
+}
+
+
+/// replace stretches of similar counts by their average, length-limiting algorithms then tend to assign equal code lengths (=> longer runs)
+/** @param  numCodes  number of codes
+ *  @param  histogram how often each code/symbol was found
+ *  @param  shift     a count belongs to a stretch if it differs from the stretch's average by at most (average >> shift) + absolute
+ *  @param  absolute  see shift, small counts (including zeros) can only join a stretch if absolute > 0
+ *  @param  smoothed  [out] modified histogram, each used symbol is still used
+ *  @result number of modified counts
+ */
+static unsigned int smoothHistogram(unsigned int numCodes, const unsigned int histogram[], unsigned char shift, unsigned char absolute, unsigned int smoothed[])
+{
+  // stretches must be long enough to be run-length encoded (first length + symbol 16 for at least 3 repetitions)
+  const unsigned int MinStretch = 4;
+
+  unsigned int numModified = 0;
+  unsigned int i = 0;
+  while (i < numCodes)
+  {
+    // extend stretch as long as counts are similar to its running average
+    unsigned long long sum = histogram[i];
+    unsigned int end = i + 1;
+    for (; end < numCodes; end++)
+    {
+      unsigned long long average = sum / (end - i);
+      unsigned long long count   = histogram[end];
+      unsigned long long diff    = count > average ? count - average : average - count;
+      if (diff > (average >> shift) + absolute)
+        break;
+      sum += count;
+    }
+
+    unsigned int length = end - i;
+    if (length >= MinStretch)
+    {
+      // rounded average, but never turn a used symbol into an unused one
+      unsigned int average = (unsigned int) ((sum + length / 2) / length);
+      if (average == 0 && sum > 0)
+        average = 1;
+      for (; i < end; i++)
+      {
+        numModified += histogram[i] != average;
+        smoothed[i]  = average;
+      }
+    }
+    else
+      for (; i < end; i++)
+        smoothed[i] = histogram[i];
+  }
+
+  return numModified;
+}
+
+
+/// estimate how many bits the run-length encoded code lengths from..to-1 need while keeping the code length code fixed
+/** @param  codeLengths code lengths of literals/lengths and distances (as stored in the header)
+ *  @param  from        first position, must be the beginning of a run
+ *  @param  to          one past the last position, must be the end of a run
+ *  @param  cost        bits per symbol of the code length alphabet, including extra bits
+ *  @result estimated size in bits
+ */
+static unsigned int estimateRunBits(const unsigned char codeLengths[], unsigned int from, unsigned int to, const unsigned char cost[DEFLATE_NUM_CODELENGTH])
+{
+  // same as countCodeLengthSymbols() but sums up costs instead of counting symbols
+  unsigned int result = 0;
+  unsigned int i = from;
+  while (i < to)
+  {
+    unsigned char length = codeLengths[i];
+    unsigned int  run    = 1;
+    while (i + run < to && codeLengths[i + run] == length)
+      run++;
+    i += run;
+
+    if (length == 0)
+    {
+      for (; run >= 11; run -= run < 138 ? run : 138)
+        result += cost[18];
+      if (run >= 3)
+      {
+        result += cost[17];
+        run = 0;
+      }
+    }
+    else
+    {
+      result += cost[length];
+      run--;
+      for (; run >= 3; run -= run < 6 ? run : 6)
+        result += cost[16];
+    }
+
+    result += run * cost[length];
+  }
+
+  return result;
+}
+
+
+/// find the most frequent and the rarest symbol of each code length
+static void findPartners(unsigned int from, unsigned int to, const unsigned char codeLengths[], const unsigned long long count[],
+                         unsigned int mostFrequent[DEFLATE_MAX_LENGTH + 1], unsigned int rarest[DEFLATE_MAX_LENGTH + 1])
+{
+  unsigned int i;
+  for (i = 0; i <= DEFLATE_MAX_LENGTH; i++)
+  {
+    mostFrequent[i] = to;
+    rarest      [i] = to;
+  }
+
+  for (i = from; i < to; i++)
+  {
+    unsigned char length = codeLengths[i];
+    if (mostFrequent[length] == to || count[i] > count[mostFrequent[length]])
+      mostFrequent[length] = i;
+    if (rarest      [length] == to || count[i] < count[rarest      [length]])
+      rarest      [length] = i;
+  }
+}
+
+
+/// compute the exact size of a dynamic block's header
+/** - code lengths must not exceed 15 bits
+ *  @param  litLengths  code lengths of all 286 literal/length symbols (unused symbols are zero)
+ *  @param  distLengths code lengths of all 30 distance symbols (unused symbols are zero)
+ *  @param  algorithm   length-limiting algorithm for the code length code, NULL => packageMerge
+ *  @param  header      [out] details, may be NULL
+ *  @result size of the header in bits (excluding the 3 bits BFINAL/BTYPE), 0 if error
+ */
+unsigned int deflateHeaderBits(const unsigned char litLengths[DEFLATE_NUM_LITERALS], const unsigned char distLengths[DEFLATE_NUM_DISTANCES],
+                               DeflateHeaderAlgorithm algorithm, DeflateHeader* header)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  if (algorithm == NULL)
+    algorithm = packageMerge;
+
+  // use caller's struct or a local one
+  DeflateHeader local;
+  if (header == NULL)
+    header = &local;
+  header->totalBits = 0;
+
+  // trailing zeros aren't stored
+  unsigned int numLiterals = DEFLATE_NUM_LITERALS;
+  while (numLiterals > 257 && litLengths[numLiterals - 1] == 0)
+    numLiterals--;
+  unsigned int numDistances = DEFLATE_NUM_DISTANCES;
+  while (numDistances > 1 && distLengths[numDistances - 1] == 0)
+    numDistances--;
+  header->numLiterals  = numLiterals;
+  header->numDistances = numDistances;
+
+  // both sequences are run-length encoded as a whole, runs may continue from literals to distances
+  unsigned char lengths[DEFLATE_NUM_LITERALS + DEFLATE_NUM_DISTANCES];
+  for (i = 0; i < numLiterals; i++)
+  {
+    if (litLengths[i] > DEFLATE_MAX_LENGTH)
+      return 0;
+    lengths[i] = litLengths[i];
+  }
+  for (i = 0; i < numDistances; i++)
+  {
+    if (distLengths[i] > DEFLATE_MAX_LENGTH)
+      return 0;
+    lengths[numLiterals + i] = distLengths[i];
+  }
+
+  for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+    header->histogram[i] = 0;
+  countCodeLengthSymbols(numLiterals + numDistances, lengths, header->histogram);
+
+  // build the code length code, limited to 7 bits
+  if (algorithm(DEFLATE_MAX_CODELENGTH, DEFLATE_NUM_CODELENGTH, header->histogram, header->codeLengths) == 0)
+    return 0;
+
+  // zlib rejects incomplete code length codes
+  unsigned int numUsed = 0;
+  unsigned int kraft   = 0; // in units of 2^-7
+  for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+    if (header->codeLengths[i] > 0)
+    {
+      numUsed++;
+      kraft += 1 << (DEFLATE_MAX_CODELENGTH - header->codeLengths[i]);
+    }
+
+  if (numUsed == 1)
+  {
+    // a single symbol needs a second, unused code: 1 bit each
+    for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+      if (header->codeLengths[i] > 0)
+        header->codeLengths[i] = 1;
+    for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+    {
+      // the unused symbol should be stored as early as possible (keeps HCLEN small)
+      unsigned char symbol = codeLengthOrder[i];
+      if (header->codeLengths[symbol] == 0)
+      {
+        header->codeLengths[symbol] = 1;
+        break;
+      }
+    }
+  }
+  else
+  {
+    // some algorithms (e.g. limitedKraftHeap) may leave a few code points unused:
+    // shorten codes until the code is complete, each step makes the header smaller
+    const unsigned int one = 1 << DEFLATE_MAX_CODELENGTH;
+    while (kraft < one)
+    {
+      // most frequent symbol whose shorter code still fits
+      unsigned int best = DEFLATE_NUM_CODELENGTH;
+      for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+        if (header->codeLengths[i] > 1 && kraft + (1 << (DEFLATE_MAX_CODELENGTH - header->codeLengths[i])) <= one &&
+            (best == DEFLATE_NUM_CODELENGTH || header->histogram[i] > header->histogram[best]))
+          best = i;
+
+      // shortening the longest code always fits, hence best is always valid
+      kraft += 1 << (DEFLATE_MAX_CODELENGTH - header->codeLengths[best]);
+      header->codeLengths[best]--;
+    }
+  }
+
+  // trailing zeros (in DEFLATE's order) aren't stored
+  unsigned int numCodeLengthCodes = DEFLATE_NUM_CODELENGTH;
+  while (numCodeLengthCodes > 4 && header->codeLengths[codeLengthOrder[numCodeLengthCodes - 1]] == 0)
+    numCodeLengthCodes--;
+  header->numCodeLengthCodes = numCodeLengthCodes;
+
+  // HLIT (5 bits), HDIST (5 bits), HCLEN (4 bits) and 3 bits per code length of the code length code
+  unsigned int totalBits = 5 + 5 + 4 + 3 * numCodeLengthCodes;
+  // run-length encoded code lengths
+  for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+    totalBits += header->histogram[i] * (header->codeLengths[i] + codeLengthExtraBits[i]);
+
+  header->totalBits = totalBits;
+  return totalBits;
+}
+
+
+/// size of all symbols including their extra bits (but without any header)
+/** @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  litLengths    code lengths of all 286 literal/length symbols
+ *  @param  distHistogram how often each distance symbol was found
+ *  @param  distLengths   code lengths of all 30 distance symbols
+ *  @result size in bits
+ */
+unsigned long long deflatePayloadBits(const unsigned int litHistogram [DEFLATE_NUM_LITERALS],  const unsigned char litLengths [DEFLATE_NUM_LITERALS],
+                                      const unsigned int distHistogram[DEFLATE_NUM_DISTANCES], const unsigned char distLengths[DEFLATE_NUM_DISTANCES])
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  unsigned long long result = 0;
+  for (i = 0; i < 257; i++)
+    result += litHistogram[i] * (unsigned long long) litLengths[i];
+  for (i = 257; i < DEFLATE_NUM_LITERALS; i++)
+    result += litHistogram[i] * (unsigned long long) (litLengths[i] + lengthExtraBits[i - 257]);
+  for (i = 0; i < DEFLATE_NUM_DISTANCES; i++)
+    result += distHistogram[i] * (unsigned long long) (distLengths[i] + distanceExtraBits[i]);
+
+  return result;
+}
+
+
+/// total size of a dynamic block: 3 bits BFINAL/BTYPE + header + payload
+/** @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  litLengths    code lengths of all 286 literal/length symbols
+ *  @param  distHistogram how often each distance symbol was found
+ *  @param  distLengths   code lengths of all 30 distance symbols
+ *  @param  algorithm     length-limiting algorithm for the code length code, NULL => packageMerge
+ *  @result size in bits, 0 if error
+ */
+unsigned long long deflateDynamicBlockBits(const unsigned int litHistogram [DEFLATE_NUM_LITERALS],  const unsigned char litLengths [DEFLATE_NUM_LITERALS],
+                                           const unsigned int distHistogram[DEFLATE_NUM_DISTANCES], const unsigned char distLengths[DEFLATE_NUM_DISTANCES],
+                                           DeflateHeaderAlgorithm algorithm)
+{
+  unsigned int headerBits = deflateHeaderBits(litLengths, distLengths, algorithm, NULL);
+  if (headerBits == 0)
+    return 0;
+
+  return 3 + headerBits + deflatePayloadBits(litHistogram, litLengths, distHistogram, distLengths);
+}
+
+
+/// total size of a block with DEFLATE's fixed Huffman codes: 3 bits BFINAL/BTYPE + payload
+/** @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  distHistogram how often each distance symbol was found
+ *  @result size in bits
+ */
+unsigned long long deflateStaticBlockBits(const unsigned int litHistogram[DEFLATE_NUM_LITERALS], const unsigned int distHistogram[DEFLATE_NUM_DISTANCES])
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  // RFC 1951, section 3.2.6
+  unsigned char litLengths [DEFLATE_NUM_LITERALS];
+  unsigned char distLengths[DEFLATE_NUM_DISTANCES];
+  for (i =   0; i < 144;                  i++) litLengths[i] = 8;
+  for (i = 144; i < 256;                  i++) litLengths[i] = 9;
+  for (i = 256; i < 280;                  i++) litLengths[i] = 7;
+  for (i = 280; i < DEFLATE_NUM_LITERALS; i++) litLengths[i] = 8;
+  for (i =   0; i < DEFLATE_NUM_DISTANCES; i++)
+    distLengths[i] = 5;
+
+  return 3 + deflatePayloadBits(litHistogram, litLengths, distHistogram, distLengths);
+}
+
+
+/// adjust code lengths such that payload + header of a dynamic block become smaller
+/** - stretches of similar counts are averaged and the code is rebuilt, accepted only if the total size shrinks
+ *  - literal/length and distance codes are optimized one after another
+ *  - then single symbols adopt a neighbor's code length (=> longer runs) by swapping lengths with another symbol of the same code
+ *  @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  litLengths    [in/out] code lengths of all 286 literal/length symbols, e.g. computed by packageMerge
+ *  @param  distHistogram how often each distance symbol was found
+ *  @param  distLengths   [in/out] code lengths of all 30 distance symbols
+ *  @param  algorithm     length-limiting algorithm for all codes, NULL => packageMerge
+ *  @result size of the dynamic block in bits (never larger than before), 0 if error
+ */
+unsigned long long deflateOptimizeLengths(const unsigned int litHistogram [DEFLATE_NUM_LITERALS],  unsigned char litLengths [DEFLATE_NUM_LITERALS],
+                                          const unsigned int distHistogram[DEFLATE_NUM_DISTANCES], unsigned char distLengths[DEFLATE_NUM_DISTANCES],
+                                          DeflateHeaderAlgorithm algorithm)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  if (algorithm == NULL)
+    algorithm = packageMerge;
+
+  unsigned long long best = deflateDynamicBlockBits(litHistogram, litLengths, distHistogram, distLengths, algorithm);
+  if (best == 0)
+    return 0;
+
+  unsigned int  smoothed [DEFLATE_NUM_LITERALS];
+  unsigned char candidate[DEFLATE_NUM_LITERALS];
+
+  // first literals/lengths, then distances
+  unsigned int alphabet;
+  for (alphabet = 0; alphabet < 2; alphabet++)
+  {
+    unsigned int        numCodes  = alphabet == 0 ? DEFLATE_NUM_LITERALS : DEFLATE_NUM_DISTANCES;
+    const unsigned int* histogram = alphabet == 0 ? litHistogram         : distHistogram;
+    unsigned char*      lengths   = alphabet == 0 ? litLengths           : distLengths;
+
+    // tolerate deviations of 50% + 2, 25% + 4 and 12.5% + 4
+    static const unsigned char Tolerance[3][2] = { { 1, 2 }, { 2, 4 }, { 3, 4 } };
+    unsigned int attempt;
+    for (attempt = 0; attempt < 3; attempt++)
+    {
+      // nothing changed ? => same code
+      if (smoothHistogram(numCodes, histogram, Tolerance[attempt][0], Tolerance[attempt][1], smoothed) == 0)
+        continue;
+      unsigned char maxLength = algorithm(DEFLATE_MAX_LENGTH, numCodes, smoothed, candidate);
+      if (maxLength == 0 || maxLength > DEFLATE_MAX_LENGTH)
+        continue;
+
+      unsigned long long total = alphabet == 0 ?
+        deflateDynamicBlockBits(histogram,    candidate,  distHistogram, distLengths, algorithm) :
+        deflateDynamicBlockBits(litHistogram, litLengths, histogram,     candidate,   algorithm);
+      if (total == 0 || total >= best)
+        continue;
+
+      // greedy: keep the best code so far
+      best = total;
+      for (i = 0; i < numCodes; i++)
+        lengths[i] = candidate[i];
+    }
+  }
+
+  // ----- greedy adjustment of single code lengths -----
+  // a symbol adopts the code length of a neighbor (=> longer run) and swaps lengths with another symbol of the same code:
+  // the Kraft sum doesn't change, hence both codes stay complete and no code exceeds 15 bits
+
+  // header stores literals/lengths and distances without trailing zeros as a single sequence
+  unsigned int numLiterals = DEFLATE_NUM_LITERALS;
+  while (numLiterals > 257 && litLengths[numLiterals - 1] == 0)
+    numLiterals--;
+  unsigned int numDistances = DEFLATE_NUM_DISTANCES;
+  while (numDistances > 1 && distLengths[numDistances - 1] == 0)
+    numDistances--;
+  unsigned int numCodes = numLiterals + numDistances;
+
+  // only used symbols are swapped, therefore the number of trailing zeros never changes
+  unsigned char      sequence[DEFLATE_NUM_LITERALS + DEFLATE_NUM_DISTANCES];
+  unsigned long long count   [DEFLATE_NUM_LITERALS + DEFLATE_NUM_DISTANCES];
+  for (i = 0; i < numLiterals; i++)
+  {
+    sequence[i] = litLengths[i];
+    count   [i] = litHistogram[i];
+  }
+  for (i = 0; i < numDistances; i++)
+  {
+    sequence[numLiterals + i] = distLengths[i];
+    count   [numLiterals + i] = distHistogram[i];
+  }
+
+  // bits per symbol of the current code length code (unused symbols: 7 bits)
+  DeflateHeader header;
+  unsigned char cost[DEFLATE_NUM_CODELENGTH];
+  if (deflateHeaderBits(litLengths, distLengths, algorithm, &header) == 0)
+    return best;
+  for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+    cost[i] = (header.codeLengths[i] > 0 ? header.codeLengths[i] : DEFLATE_MAX_CODELENGTH) + codeLengthExtraBits[i];
+
+  // cheapest partners: the most frequent symbol if it gets a shorter code, else the rarest
+  unsigned int mostFrequent[2][DEFLATE_MAX_LENGTH + 1];
+  unsigned int rarest      [2][DEFLATE_MAX_LENGTH + 1];
+  findPartners(0,           numLiterals, sequence, count, mostFrequent[0], rarest[0]);
+  findPartners(numLiterals, numCodes,    sequence, count, mostFrequent[1], rarest[1]);
+
+  // repeat until nothing improves anymore
+  const unsigned int MaxPasses = 4;
+  unsigned int pass;
+  int improved = 1;
+  for (pass = 0; pass < MaxPasses && improved; pass++)
+  {
+    improved = 0;
+
+    unsigned int pos;
+    for (pos = 0; pos < numCodes; pos++)
+    {
+      unsigned int side;
+      for (side = 0; side < 2; side++)
+      {
+        unsigned char length = sequence[pos];
+        if (length == 0)
+          break;
+
+        // code length of the left or right neighbor
+        if ((side == 0 && pos == 0) || (side == 1 && pos + 1 == numCodes))
+          continue;
+        unsigned char target = sequence[side == 0 ? pos - 1 : pos + 1];
+        if (target == 0 || target == length)
+          continue;
+
+        unsigned int code = pos < numLiterals ? 0 : 1;
+        unsigned int partner  = target > length ? mostFrequent[code][target] : rarest[code][target];
+        if (partner == (code == 0 ? numLiterals : numCodes))
+          continue;
+
+        // extra bits of the payload (or fewer if negative)
+        long long payload = ((long long)target - length) * ((long long)count[pos] - (long long)count[partner]);
+
+        // only runs touching a modified position (or its neighbors) can change:
+        // their boundaries depend on unmodified code lengths only
+        unsigned int changed[2] = { pos, partner };
+        unsigned int from[2], to[2];
+        unsigned int k;
+        for (k = 0; k < 2; k++)
+        {
+          from[k] = changed[k] > 0 ? changed[k] - 1 : 0;
+          while (from[k] > 0 && sequence[from[k] - 1] == sequence[from[k]])
+            from[k]--;
+          to[k] = changed[k] + 2 < numCodes ? changed[k] + 2 : numCodes;
+          while (to[k] < numCodes && sequence[to[k]] == sequence[to[k] - 1])
+            to[k]++;
+        }
+        // overlapping or adjacent windows are merged
+        int merged = from[0] <= to[1] && from[1] <= to[0];
+        if (merged)
+        {
+          from[0] = from[0] < from[1] ? from[0] : from[1];
+          to  [0] = to  [0] > to  [1] ? to  [0] : to  [1];
+        }
+        unsigned int numWindows = merged ? 1 : 2;
+
+        unsigned int before = 0;
+        for (k = 0; k < numWindows; k++)
+          before += estimateRunBits(sequence, from[k], to[k], cost);
+
+        sequence[pos]     = target;
+        sequence[partner] = length;
+
+        unsigned int after = 0;
+        for (k = 0; k < numWindows; k++)
+          after += estimateRunBits(sequence, from[k], to[k], cost);
+
+        if ((long long)after + payload < (long long)before)
+        {
+          // verify with a rebuilt code length code
+          unsigned char* lengths = code == 0 ? litLengths : distLengths;
+          unsigned int   offset  = code == 0 ? 0          : numLiterals;
+          lengths[pos     - offset] = target;
+          lengths[partner - offset] = length;
+
+          unsigned long long total = deflateDynamicBlockBits(litHistogram, litLengths, distHistogram, distLengths, algorithm);
+          if (total != 0 && total < best)
+          {
+            best     = total;
+            improved = 1;
+
+            // code length code may have changed
+            deflateHeaderBits(litLengths, distLengths, algorithm, &header);
+            for (i = 0; i < DEFLATE_NUM_CODELENGTH; i++)
+              cost[i] = (header.codeLengths[i] > 0 ? header.codeLengths[i] : DEFLATE_MAX_CODELENGTH) + codeLengthExtraBits[i];
+            if (code == 0)
+              findPartners(0,           numLiterals, sequence, count, mostFrequent[0], rarest[0]);
+            else
+              findPartners(numLiterals, numCodes,    sequence, count, mostFrequent[1], rarest[1]);
+            continue;
+          }
+
+          lengths[pos     - offset] = length;
+          lengths[partner - offset] = target;
+        }
+
+        // undo
+        sequence[pos]     = length;
+        sequence[partner] = target;
+      }
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,111 @@
+// //////////////////////////////////////////////////////////
+// deflateheader.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// exact size of DEFLATE blocks (RFC 1951), including the overhead of a dynamic block's header:
+// - HLIT/HDIST/HCLEN, the code length code (19 symbols, limited to 7 bits) and the run-length encoded code lengths
+// - literal/length and distance code lengths form a single sequence, runs may cross the border between both
+// - runs are encoded greedily: 18 = 11 to 138 zeros, 17 = 3 to 10 zeros, 16 = repeat previous length 3 to 6 times
+// - the code length code can be built by any length-limiting algorithm (default: packageMerge)
+// - example:
+//   unsigned int headerBits = deflateHeaderBits(litLengths, distLengths, NULL, NULL);
+//   unsigned int blockBits  = deflateDynamicBlockBits(litHistogram, litLengths, distHistogram, distLengths, NULL);
+//   if (deflateStaticBlockBits(litHistogram, distHistogram) <= blockBits) ... prefer a static block
+// - deflateOptimizeLengths() trades a few bits of payload for a smaller header (most useful for small blocks)
+
+/// 256 literals, end-of-block and 29 lengths (286 and 287 are invalid)
+#define DEFLATE_NUM_LITERALS   286
+/// 30 distances (30 and 31 are invalid)
+#define DEFLATE_NUM_DISTANCES   30
+/// 16, 17, 18 and lengths 0 to 15
+#define DEFLATE_NUM_CODELENGTH  19
+/// DEFLATE's longest code
+#define DEFLATE_MAX_LENGTH      15
+/// code length code's longest code
+#define DEFLATE_MAX_CODELENGTH   7
+
+/// same interface as all length-limiting algorithms, e.g. packageMerge or limitedKraftHeap
+typedef unsigned char (*DeflateHeaderAlgorithm)(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+/// all details of a dynamic block's header
+typedef struct
+{
+  /// HLIT + 257: number of literal/length code lengths (without trailing zeros, at least 257)
+  unsigned int  numLiterals;
+  /// HDIST + 1: number of distance code lengths (without trailing zeros, at least 1)
+  unsigned int  numDistances;
+  /// HCLEN + 4: number of code length code lengths (in DEFLATE's peculiar order, at least 4)
+  unsigned int  numCodeLengthCodes;
+  /// how often each symbol of the code length code is used
+  unsigned int  histogram[DEFLATE_NUM_CODELENGTH];
+  /// code lengths of the code length code (indexed by symbol, not in DEFLATE's order)
+  unsigned char codeLengths[DEFLATE_NUM_CODELENGTH];
+  /// total size of the header in bits (excluding the 3 bits BFINAL/BTYPE)
+  unsigned int  totalBits;
+} DeflateHeader;
+
+/// compute the exact size of a dynamic block's header
+/** - code lengths must not exceed 15 bits
+ *  @param  litLengths  code lengths of all 286 literal/length symbols (unused symbols are zero)
+ *  @param  distLengths code lengths of all 30 distance symbols (unused symbols are zero)
+ *  @param  algorithm   length-limiting algorithm for the code length code, NULL => packageMerge
+ *  @param  header      [out] details, may be NULL
+ *  @result size of the header in bits (excluding the 3 bits BFINAL/BTYPE), 0 if error
+ */
+unsigned int deflateHeaderBits(const unsigned char litLengths[DEFLATE_NUM_LITERALS], const unsigned char distLengths[DEFLATE_NUM_DISTANCES],
+                               DeflateHeaderAlgorithm algorithm, DeflateHeader* header);
+
+/// size of all symbols including their extra bits (but without any header)
+/** @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  litLengths    code lengths of all 286 literal/length symbols
+ *  @param  distHistogram how often each distance symbol was found
+ *  @param  distLengths   code lengths of all 30 distance symbols
+ *  @result size in bits
+ */
+unsigned long long deflatePayloadBits(const unsigned int litHistogram [DEFLATE_NUM_LITERALS],  const unsigned char litLengths [DEFLATE_NUM_LITERALS],
+                                      const unsigned int distHistogram[DEFLATE_NUM_DISTANCES], const unsigned char distLengths[DEFLATE_NUM_DISTANCES]);
+
+/// total size of a dynamic block: 3 bits BFINAL/BTYPE + header + payload
+/** @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  litLengths    code lengths of all 286 literal/length symbols
+ *  @param  distHistogram how often each distance symbol was found
+ *  @param  distLengths   code lengths of all 30 distance symbols
+ *  @param  algorithm     length-limiting algorithm for the code length code, NULL => packageMerge
+ *  @result size in bits, 0 if error
+ */
+unsigned long long deflateDynamicBlockBits(const unsigned int litHistogram [DEFLATE_NUM_LITERALS],  const unsigned char litLengths [DEFLATE_NUM_LITERALS],
+                                           const unsigned int distHistogram[DEFLATE_NUM_DISTANCES], const unsigned char distLengths[DEFLATE_NUM_DISTANCES],
+                                           DeflateHeaderAlgorithm algorithm);
+
+/// total size of a block with DEFLATE's fixed Huffman codes: 3 bits BFINAL/BTYPE + payload
+/** @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  distHistogram how often each distance symbol was found
+ *  @result size in bits
+ */
+unsigned long long deflateStaticBlockBits(const unsigned int litHistogram[DEFLATE_NUM_LITERALS], const unsigned int distHistogram[DEFLATE_NUM_DISTANCES]);
+
+/// adjust code lengths such that payload + header of a dynamic block become smaller
+/** - stretches of similar counts are averaged and the code is rebuilt, accepted only if the total size shrinks
+ *  - literal/length and distance codes are optimized one after another
+ *  - then single symbols adopt a neighbor's code length (=> longer runs) by swapping lengths with another symbol of the same code
+ *  @param  litHistogram  how often each literal/length symbol was found (including a single end-of-block symbol)
+ *  @param  litLengths    [in/out] code lengths of all 286 literal/length symbols, e.g. computed by packageMerge
+ *  @param  distHistogram how often each distance symbol was found
+ *  @param  distLengths   [in/out] code lengths of all 30 distance symbols
+ *  @param  algorithm     length-limiting algorithm for all codes, NULL => packageMerge
+ *  @result size of the dynamic block in bits (never larger than before), 0 if error
+ */
+unsigned long long deflateOptimizeLengths(const unsigned int litHistogram [DEFLATE_NUM_LITERALS],  unsigned char litLengths [DEFLATE_NUM_LITERALS],
+                                          const unsigned int distHistogram[DEFLATE_NUM_DISTANCES], unsigned char distLengths[DEFLATE_NUM_DISTANCES],
+                                          DeflateHeaderAlgorithm algorithm);
+
+#ifdef __cplusplus
+}
+#endif
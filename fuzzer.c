@@ -4,11 +4,14 @@
 // see https://create.stephan-brumme.com/length-limited-prefix-codes/
 //
 
-// afl-gcc fuzzer.c limited*.c packagemerge.c moffat.c -o fuzzer
+// afl-gcc fuzzer.c limited*.c packagemerge.c moffat.c jpegtables.c slidingwindow.c lengthlimitstats.c -o fuzzer
 // to be used by afl-gcc
 // afl-fuzz -i afl-testcases -o afl-findings
 
 // it's histogram.c + running a length-limiting algorithm
+// + a differential check: limitedJpegInPlace() must produce the same results as the one-step-at-a-time loop of JPEG Annex K.3
+// + jpegBuildTable() must reserve the all-ones code and its HUFFVAL must contain each used byte exactly once
+// + all bytes pass through two sliding windows: one with LIMIT_BITS (always succeeds) and one with just 4 bits (fails for more than 16 different bytes)
 
 // settings (hard-coded):
 #define LIMIT_BITS 8
@@ -18,9 +21,11 @@
 #include "packagemerge.h"
 #include "moffat.h"
 #include "limitedjpegdeflate.h"
+#include "jpegtables.h"
 #include "limitedbzip2.h"
 #include "limitedkraft.h"
 #include "limitedkraftheap.h"
+#include "slidingwindow.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +34,41 @@
 #define BUFFERSIZE (64*1024)
 // 256 codes
 #define MAXSYMBOLS 256
+// sliding windows
+#define WINDOWSIZE 1024
+#define WINDOWTHRESHOLD 100
+#define WINDOWSHORTBITS 4
+
+// JPEG Annex K.3 as written in the specification: one pair per iteration (limitedJpegInPlace processes all pairs at once)
+static unsigned char referenceJpegInPlace(unsigned char newMaxLength, unsigned char oldMaxLength, unsigned int histNumBits[])
+{
+  if (newMaxLength <= 1 || newMaxLength > oldMaxLength)
+    return 0;
+
+  unsigned char i = oldMaxLength;
+  while (i > newMaxLength)
+  {
+    if (histNumBits[i] == 0)
+    {
+      i--;
+      continue;
+    }
+
+    unsigned char j = i - 2;
+    while (j > 0 && histNumBits[j] == 0)
+      j--;
+
+    histNumBits[i] -= 2;
+    histNumBits[i - 1]++;
+    histNumBits[j + 1] += 2;
+    histNumBits[j]--;
+  }
+
+  while (i > 0 && histNumBits[i] == 0)
+    i--;
+  return i;
+}
+
 
 // cause AFL to detect a crash
 int crash(int code)
@@ -51,6 +91,12 @@ int main(int argc, char** argv)
   // histogram
   unsigned int histogram[MAXSYMBOLS] = { 0 };
 
+  // adaptive codes
+  SlidingWindow window, shortWindow;
+  if (!slidingWindowInit(&window,      ALGORITM, LIMIT_BITS,      MAXSYMBOLS, WINDOWSIZE, WINDOWTHRESHOLD) ||
+      !slidingWindowInit(&shortWindow, ALGORITM, WINDOWSHORTBITS, MAXSYMBOLS, WINDOWSIZE, WINDOWTHRESHOLD))
+    crash(4);
+
   // read 64k chunks and adjust histogram
   unsigned char buffer[BUFFERSIZE];
   size_t totalBytes = 0;
@@ -66,8 +112,27 @@ int main(int argc, char** argv)
     // histogram
     for (i = 0; i < numRead; i++)
       histogram[buffer[i]]++;
+
+    // each byte must be encodable unless the algorithm failed
+    for (i = 0; i < numRead; i++)
+    {
+      slidingWindowAdd(&window,      buffer[i]);
+      slidingWindowAdd(&shortWindow, buffer[i]);
+      if (window.codeLengths[buffer[i]] == 0 ||
+         (shortWindow.maxBits > 0 && shortWindow.codeLengths[buffer[i]] == 0))
+        crash(4);
+    }
   }
 
+  // incrementally tracked cost must match the current histogram
+  unsigned long long windowCost = 0;
+  for (i = 0; i < MAXSYMBOLS; i++)
+    windowCost += window.codeLengths[i] * (unsigned long long) window.histogram[i];
+  if (windowCost != window.cost)
+    crash(5);
+  slidingWindowFree(&window);
+  slidingWindowFree(&shortWindow);
+
   unsigned char codeLengths[MAXSYMBOLS];
   unsigned char maxBits = ALGORITM(LIMIT_BITS, MAXSYMBOLS, histogram, codeLengths);
 
@@ -88,5 +153,51 @@ int main(int argc, char** argv)
   if (kraft > 1)
     crash(2);
 
+  // JPEG table: Kraft sum of BITS less than 1.0 (in units of 2^-16) and HUFFVAL equals the set of used bytes
+  JpegHuffmanTable table;
+  if (jpegBuildTable(MAXSYMBOLS, histogram, &table) == 0 || table.numSymbols != numUsedCodes)
+    crash(6);
+  unsigned int jpegKraft = 0, jpegSymbols = 0;
+  for (i = 0; i < JPEG_MAX_LENGTH; i++)
+  {
+    jpegKraft   += table.bits[i] << (JPEG_MAX_LENGTH - (i + 1));
+    jpegSymbols += table.bits[i];
+  }
+  if (jpegKraft >= (1U << JPEG_MAX_LENGTH) || jpegSymbols != table.numSymbols)
+    crash(6);
+  unsigned char seen[MAXSYMBOLS] = { 0 };
+  for (i = 0; i < table.numSymbols; i++)
+  {
+    if (histogram[table.huffval[i]] == 0 || seen[table.huffval[i]])
+      crash(6);
+    seen[table.huffval[i]] = 1;
+  }
+
+  // differential check: reduce unlimited Huffman codes to each shorter length limit
+  unsigned char unlimited[MAXSYMBOLS];
+  unsigned char maxUnlimited = moffat(MAXSYMBOLS, histogram, unlimited);
+  unsigned char limit;
+  for (limit = 2; limit < maxUnlimited; limit++)
+  {
+    // at most 256 symbols
+    if ((1U << limit) < numUsedCodes)
+      continue;
+
+    unsigned int fast     [64] = { 0 };
+    unsigned int reference[64] = { 0 };
+    for (i = 0; i < MAXSYMBOLS; i++)
+      if (unlimited[i] > 0)
+      {
+        fast     [unlimited[i]]++;
+        reference[unlimited[i]]++;
+      }
+
+    if (limitedJpegInPlace(limit, maxUnlimited, fast) != referenceJpegInPlace(limit, maxUnlimited, reference))
+      crash(3);
+    for (i = 0; i < 64; i++)
+      if (fast[i] != reference[i])
+        crash(3);
+  }
+
   return 0;
 }
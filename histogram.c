@@ -5,12 +5,14 @@
 //
 
 // gcc histogram.c -o histogram -Wall -O3
-// ./histogram [filename]
+// ./histogram [filename] [blocksize]
 // if filename is "-" then the program reads from STDIN
 
 // count how often each byte is found in a file
 // output is their frequency delimited by a whitespace
 // if a symbol doesn't occur then its frequency is zero
+// if blocksize is specified then each block of that many bytes gets its own histogram (one per line)
+// => such a "corpus" can be processed by the benchmark program
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,16 +20,36 @@
 // read 64k at once
 #define BUFFERSIZE (64*1024)
 
+// print histogram and reset it
+static void showHistogram(unsigned int histogram[256])
+{
+  int i;
+  printf("%d", histogram[0]);
+  histogram[0] = 0;
+  for (i = 1; i < 256; i++)
+  {
+    printf(" %d", histogram[i]);
+    histogram[i] = 0;
+  }
+  printf("\n");
+}
+
 int main(int argc, char** argv)
 {
-  // needs exactly one command-line parameter
-  if (argc != 2)
+  // needs one or two command-line parameters
+  if (argc != 2 && argc != 3)
   {
-    printf("syntax: ./histogram [filename]\n"
-           "if filename is - then read from STDIN\n");
+    printf("syntax: ./histogram [filename] [blocksize]\n"
+           "if filename is - then read from STDIN\n"
+           "if blocksize is specified then print one histogram per block\n");
     return 1;
   }
 
+  // 0 => whole file
+  long blockSize = argc == 3 ? atol(argv[2]) : 0;
+  if (blockSize < 0)
+    return 1;
+
   // open file (or STDIN)
   FILE* handle = stdin;
   const char* filename = argv[1];
@@ -46,6 +68,8 @@ int main(int argc, char** argv)
 
   // histogram
   unsigned int histogram[256] = { 0 };
+  // number of bytes in the current block
+  long numBytes = 0;
 
   // read 64k chunks and adjust histogram
   unsigned char buffer[BUFFERSIZE];
@@ -58,17 +82,24 @@ int main(int argc, char** argv)
 
     // histogram
     for (i = 0; i < numRead; i++)
+    {
       histogram[buffer[i]]++;
+
+      // block finished ?
+      if (++numBytes == blockSize)
+      {
+        showHistogram(histogram);
+        numBytes = 0;
+      }
+    }
   }
 
   if (handle != stdin)
     fclose(handle);
 
-  // show histogram
-  printf("%d", histogram[0]);
-  for (i = 1; i < 256; i++)
-    printf(" %d", histogram[i]);
-  printf("\n");
+  // show histogram (or the last, incomplete block)
+  if (numBytes > 0 || blockSize == 0)
+    showHistogram(histogram);
 
   return 0;
 }
@@ -0,0 +1,186 @@
+// //////////////////////////////////////////////////////////
+// jpegtables.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "jpegtables.h"
+
+#include "moffat.h"             // moffatSortedHistNumBits
+#include "limitedjpegdeflate.h" // limitedJpegInPlace
+#include <stdlib.h> // qsort
+
+
+// helper struct for qsort()
+struct KeyValue
+{
+  unsigned int key;
+  unsigned int value;
+};
+// helper function for qsort()
+static int compareKeyValue(const void* a, const void* b)
+{
+  struct KeyValue* aa = (struct KeyValue*) a;
+  struct KeyValue* bb = (struct KeyValue*) b;
+  return aa->key - bb->key; // negative if a < b, zero if a == b, positive if a > b
+}
+
+
+/// build an optimized Huffman table, limited to 16 bits and without the all-ones code
+/** @param  numCodes  number of codes, at most 256
+ *  @param  histogram how often each code/symbol was found
+ *  @param  table     [out] BITS, HUFFVAL and numSymbols
+ *  @result actual maximum code length, 0 if error (no symbol used or more than 256 codes)
+ */
+unsigned char jpegBuildTable(unsigned int numCodes, const unsigned int histogram[], JpegHuffmanTable* table)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  table->numSymbols = 0;
+  for (i = 0; i < JPEG_MAX_LENGTH; i++)
+    table->bits[i] = 0;
+
+  // JPEG symbols are bytes
+  if (numCodes > 256)
+    return 0;
+
+  // at most 256 symbols: no need for heap memory
+  struct KeyValue mapping[256];
+  unsigned int numNonZero = 0;
+  for (i = 0; i < numCodes; i++)
+    if (histogram[i] > 0)
+    {
+      mapping[numNonZero].key   = histogram[i];
+      mapping[numNonZero].value = i;
+      numNonZero++;
+    }
+  if (numNonZero == 0)
+    return 0;
+
+  qsort(mapping, numNonZero, sizeof(struct KeyValue), compareKeyValue);
+
+  // Annex K.2: reserve one code point by adding a dummy symbol with count 1,
+  // it becomes the first (=least frequent) element of the sorted histogram
+  unsigned int sorted[256 + 1];
+  sorted[0] = 1;
+  for (i = 0; i < numNonZero; i++)
+    sorted[i + 1] = mapping[i].key;
+
+  // Huffman codes, but only count how many codes have a certain length
+  unsigned int histNumBits[64];
+  unsigned char maxLength = moffatSortedHistNumBits(numNonZero + 1, sorted, histNumBits);
+  if (maxLength == 0)
+    return 0;
+
+  // Annex K.3: limit to 16 bits
+  if (maxLength > JPEG_MAX_LENGTH)
+  {
+    maxLength = limitedJpegInPlace(JPEG_MAX_LENGTH, maxLength, histNumBits);
+    if (maxLength == 0)
+      return 0;
+  }
+
+  // code lengths are in descending order, assign them
+  // (the dummy symbol gets one of the longest codes: the all-ones code of the canonical code)
+  unsigned char codeLengths[256];
+  unsigned char reduce = maxLength;
+  unsigned int  remaining = histNumBits[reduce] - 1; // skip dummy symbol
+  for (i = 0; i < numNonZero; i++)
+  {
+    while (remaining == 0)
+    {
+      reduce--;
+      remaining = histNumBits[reduce];
+    }
+    codeLengths[i] = reduce;
+    remaining--;
+  }
+
+  // ... and remove the dummy symbol
+  histNumBits[maxLength]--;
+  // BITS
+  for (i = 1; i <= JPEG_MAX_LENGTH; i++)
+    table->bits[i - 1] = (unsigned char) histNumBits[i];
+
+  // HUFFVAL: sorted by code length, then by symbol
+  // (codeLengths are indexed by the position in the sorted histogram, so first restore the original order)
+  unsigned char lengthOfSymbol[256];
+  for (i = 0; i < numCodes; i++)
+    lengthOfSymbol[i] = 0;
+  for (i = 0; i < numNonZero; i++)
+    lengthOfSymbol[mapping[i].value] = codeLengths[i];
+
+  unsigned char length;
+  for (length = 1; length <= JPEG_MAX_LENGTH; length++)
+    for (i = 0; i < numCodes; i++)
+      if (lengthOfSymbol[i] == length)
+        table->huffval[table->numSymbols++] = (unsigned char) i;
+
+  // the dummy symbol might have been the only code with maxLength bits
+  while (maxLength > 0 && histNumBits[maxLength] == 0)
+    maxLength--;
+
+  return maxLength;
+}
+
+
+/// build all four tables of an image at once: DC luma, AC luma, DC chroma, AC chroma (in this order)
+/** @param  histograms 256 symbols each
+ *  @param  tables     [out] four tables
+ *  @result number of non-empty tables
+ */
+unsigned int jpegBuildStandardTables(const unsigned int histograms[JPEG_NUM_TABLES][256], JpegHuffmanTable tables[JPEG_NUM_TABLES])
+{
+  unsigned int result = 0;
+  unsigned int i;
+  for (i = 0; i < JPEG_NUM_TABLES; i++)
+  {
+    tables[i].tableClass = i & 1; // DC, AC, DC, AC
+    tables[i].tableId    = i / 2; // luma, luma, chroma, chroma
+    if (jpegBuildTable(256, histograms[i], &tables[i]) > 0)
+      result++;
+  }
+  return result;
+}
+
+
+/// write a DHT segment, including its marker 0xFF 0xC4 and length
+/** @param  numTables number of tables
+ *  @param  tables    Huffman tables
+ *  @param  output    [out] DHT segment
+ *  @result number of bytes written, 0 if no table was written
+ */
+unsigned int jpegWriteDht(unsigned int numTables, const JpegHuffmanTable tables[], unsigned char* output)
+{
+  // marker
+  output[0] = 0xFF;
+  output[1] = 0xC4;
+  // length (big endian) will be written at the end
+  unsigned int pos = 4;
+
+  unsigned int i;
+  for (i = 0; i < numTables; i++)
+  {
+    const JpegHuffmanTable* table = &tables[i];
+    if (table->numSymbols == 0)
+      continue;
+
+    // Tc (upper 4 bits) and Th (lower 4 bits)
+    output[pos++] = (unsigned char)((table->tableClass << 4) | table->tableId);
+    unsigned int j;
+    for (j = 0; j < JPEG_MAX_LENGTH; j++)
+      output[pos++] = table->bits[j];
+    for (j = 0; j < table->numSymbols; j++)
+      output[pos++] = table->huffval[j];
+  }
+
+  // no table at all ?
+  if (pos == 4)
+    return 0;
+
+  // the length excludes the marker
+  unsigned int length = pos - 2;
+  output[2] = (unsigned char)(length >> 8);
+  output[3] = (unsigned char)(length & 0xFF);
+  return pos;
+}
@@ -0,0 +1,77 @@
+// //////////////////////////////////////////////////////////
+// jpegtables.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// optimized Huffman tables for baseline JPEG, ready to be stored in a DHT segment:
+// - codes are limited to 16 bits (JPEG Annex K.3)
+// - the all-ones code is reserved (Annex K.2 adds a dummy symbol which is removed afterwards)
+//   because a code consisting of 1-bits only could be confused with the padding/marker prefix 0xFF
+// - the output is JPEG's BITS/HUFFVAL format: number of codes per length plus all symbols sorted by code length
+// - example:
+//   unsigned int histograms[JPEG_NUM_TABLES][256] = { ... }; // DC luma, AC luma, DC chroma, AC chroma
+//   JpegHuffmanTable tables[JPEG_NUM_TABLES];
+//   jpegBuildStandardTables(histograms, tables);
+//   unsigned char segment[JPEG_NUM_TABLES * JPEG_MAX_DHT_TABLE + 4];
+//   unsigned int  size = jpegWriteDht(JPEG_NUM_TABLES, tables, segment);
+
+/// JPEG's longest code
+#define JPEG_MAX_LENGTH     16
+/// four tables per image: DC and AC for luminance and chrominance
+#define JPEG_NUM_TABLES      4
+/// size of a single table in a DHT segment: class/id byte, BITS and up to 256 HUFFVALs
+#define JPEG_MAX_DHT_TABLE (1 + JPEG_MAX_LENGTH + 256)
+
+/// a single Huffman table
+typedef struct
+{
+  /// 0 = DC, 1 = AC
+  unsigned char tableClass;
+  /// destination identifier, 0 = luminance, 1 = chrominance (for the standard tables)
+  unsigned char tableId;
+  /// BITS: bits[i] codes have i+1 bits
+  unsigned char bits[JPEG_MAX_LENGTH];
+  /// HUFFVAL: all symbols, sorted by code length (and symbol value if equal code lengths)
+  unsigned char huffval[256];
+  /// number of valid entries in huffval, same as sum(bits)
+  unsigned int  numSymbols;
+} JpegHuffmanTable;
+
+/// build an optimized Huffman table, limited to 16 bits and without the all-ones code
+/** - the algorithm is JPEG Annex K.2 + K.3 (see limitedJpegInPlace)
+ *  - tableClass and tableId of the table are not modified
+ *  @param  numCodes  number of codes, at most 256
+ *  @param  histogram how often each code/symbol was found
+ *  @param  table     [out] BITS, HUFFVAL and numSymbols
+ *  @result actual maximum code length, 0 if error (no symbol used or more than 256 codes)
+ */
+unsigned char jpegBuildTable(unsigned int numCodes, const unsigned int histogram[], JpegHuffmanTable* table);
+
+/// build all four tables of an image at once: DC luma, AC luma, DC chroma, AC chroma (in this order)
+/** - tableClass and tableId are set accordingly
+ *  - if a histogram is empty (e.g. grayscale images don't have chrominance) then that table's numSymbols is zero
+ *  @param  histograms 256 symbols each
+ *  @param  tables     [out] four tables
+ *  @result number of non-empty tables
+ */
+unsigned int jpegBuildStandardTables(const unsigned int histograms[JPEG_NUM_TABLES][256], JpegHuffmanTable tables[JPEG_NUM_TABLES]);
+
+/// write a DHT segment, including its marker 0xFF 0xC4 and length
+/** - empty tables (numSymbols = 0) are skipped
+ *  - output needs at most 4 + numTables * JPEG_MAX_DHT_TABLE bytes
+ *  @param  numTables number of tables
+ *  @param  tables    Huffman tables
+ *  @param  output    [out] DHT segment
+ *  @result number of bytes written, 0 if no table was written
+ */
+unsigned int jpegWriteDht(unsigned int numTables, const JpegHuffmanTable tables[], unsigned char* output);
+
+#ifdef __cplusplus
+}
+#endif
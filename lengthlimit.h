@@ -0,0 +1,25 @@
+// //////////////////////////////////////////////////////////
+// lengthlimit.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+// single header for liblengthlimit.a / liblengthlimit.so, includes all public functions:
+// gcc yourcode.c -L. -llengthlimit -pthread
+
+#include "packagemerge.h"       // optimal length-limited codes (Package-Merge)
+#include "moffat.h"             // unlimited Huffman codes
+#include "twoqueue.h"           // unlimited Huffman codes (branchless two-queue algorithm)
+#include "limitedjpegdeflate.h" // adjust Huffman codes: JPEG Annex K.3 / MiniZ
+#include "jpegtables.h"         // JPEG DHT segments
+#include "deflateheader.h"      // DEFLATE block sizes including headers
+#include "limitedbzip2.h"       // rescale histogram until Huffman codes are short enough
+#include "limitedkraft.h"       // Kraft inequality (strategy A)
+#include "limitedkraftheap.h"   // Kraft inequality (strategy B)
+#include "limitedauto.h"        // choose an algorithm
+#include "codecache.h"          // re-use code lengths of similar histograms
+#include "blocksplit.h"         // split a stream into blocks with their own codes
+#include "multitable.h"         // bzip2-style assignment of segments to multiple tables
+#include "slidingwindow.h"      // adaptive streaming
+#include "lengthlimitstats.h"   // optional instrumentation
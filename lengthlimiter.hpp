@@ -0,0 +1,175 @@
+// //////////////////////////////////////////////////////////
+// lengthlimiter.hpp
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#include "moffat.h"             // unlimited Huffman codes
+#include "packagemerge.h"       // optimal length-limited codes
+#include "limitedjpegdeflate.h" // fast adjustment of Huffman codes
+#include "limitedbzip2.h"       // rescale histogram until Huffman codes are short enough
+#include <algorithm>            // std::sort
+#include <stdint.h>             // uint64_t
+
+// the C functions' convenient interface (unsorted histogram, may contain zeros) comes with some overhead:
+// - malloc/free of buffers for sorting the histogram
+// - qsort() invokes a comparison function through a pointer for every single comparison
+// if the alphabet size is fixed (e.g. DEFLATE's code length alphabet: 19 symbols, at most 7 bits)
+// then LengthLimiter sorts on the stack, each symbol's count and its ID packed into a single 64 bit integer
+// - the core algorithms (which work on a sorted histogram) are the C code's ...SortedInPlace() functions,
+//   they still receive alphabet size and length limit at runtime
+// - package-merge's buffers live on the stack, too (packageMergeSortedInPlaceWorkspace, up to 64 KB, else on the heap)
+// - example:
+//   unsigned int  histogram  [19] = { ... };
+//   unsigned char codeLengths[19];
+//   LengthLimiter<19, 7>::run(histogram, codeLengths);                   // optimal (package-merge)
+//   LengthLimiter<19, 7, LimitMiniz>::run(histogram, codeLengths);       // faster but not always optimal
+//   LengthLimiterDeflateCodeLengths::run(histogram, codeLengths);        // same as the first line
+
+
+// ---------- algorithms ----------
+
+// each algorithm gets the alphabet size and length limit as template parameters, too:
+// they may size their buffers at compile time
+
+/// package-merge, optimal code lengths
+struct LimitPackageMerge
+{
+  /// histogram A must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+  template <unsigned int NumCodes, unsigned char MaxLength>
+  static unsigned char sortedInPlace(unsigned int numCodes, unsigned int A[])
+  {
+    // all buffers on the stack unless they get too large
+    const unsigned int Words      = PACKAGEMERGE_WORKSPACE_WORDS(NumCodes, MaxLength);
+    const unsigned int StackWords = 65536 / sizeof(unsigned long long);
+    unsigned long long workspace[Words <= StackWords ? Words : 1];
+    return packageMergeSortedInPlaceWorkspace(MaxLength, numCodes, A, Words <= StackWords ? workspace : NULL);
+  }
+};
+
+
+/// bzip2's approach: scale histogram until Huffman codes are short enough
+struct LimitBzip2
+{
+  /// histogram A must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+  template <unsigned int NumCodes, unsigned char MaxLength>
+  static unsigned char sortedInPlace(unsigned int numCodes, unsigned int A[])
+  {
+    return limitedBzip2SortedInPlace(MaxLength, numCodes, A);
+  }
+};
+
+
+/// JPEG Annex K.3: Moffat's Huffman codes, adjusted by limitedJpegInPlace if too long
+struct LimitJpeg
+{
+  /// histogram A must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+  template <unsigned int NumCodes, unsigned char MaxLength>
+  static unsigned char sortedInPlace(unsigned int numCodes, unsigned int A[])
+  {
+    return limitedJpegSortedInPlace(MaxLength, numCodes, A);
+  }
+};
+
+
+/// MiniZ: Moffat's Huffman codes, adjusted by limitedMinizInPlace if too long
+struct LimitMiniz
+{
+  /// histogram A must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+  template <unsigned int NumCodes, unsigned char MaxLength>
+  static unsigned char sortedInPlace(unsigned int numCodes, unsigned int A[])
+  {
+    return limitedMinizSortedInPlace(MaxLength, numCodes, A);
+  }
+};
+
+
+// ---------- fixed alphabet size and length limit ----------
+
+/// compute length-limited code lengths for an alphabet of NumCodes symbols, no code is longer than MaxLength bits
+/** - Algorithm can be LimitPackageMerge (default), LimitJpeg, LimitMiniz or LimitBzip2
+ */
+template <unsigned int NumCodes, unsigned char MaxLength, typename Algorithm = LimitPackageMerge>
+struct LengthLimiter
+{
+  // mapping and sorted live on the stack: 12 bytes per symbol, at most 48 KB
+  static_assert(NumCodes > 0 && NumCodes <= 4096, "alphabet must contain 1 to 4096 symbols");
+  static_assert(MaxLength > 0 && MaxLength <= 63, "length limit must be between 1 and 63 bits");
+
+  /// same interface as all length-limiting algorithms but with fixed numCodes and maxLength
+  /** - histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+   *  @param  histogram  how often each code/symbol was found
+   *  @param  codeLength [out] computed code lengths
+   *  @result actual maximum code length, 0 if error
+   */
+  static unsigned char run(const unsigned int histogram[NumCodes], unsigned char codeLengths[NumCodes])
+  {
+    // upper 32 bits: count, lower 32 bits: symbol
+    // => sorting by count is just plain integer sorting (and ties are ordered by symbol ID)
+    uint64_t mapping[NumCodes];
+    unsigned int numNonZero = 0;
+    for (unsigned int i = 0; i < NumCodes; i++)
+    {
+      codeLengths[i] = 0;
+      // branchless: always write, but advance only for non-zero counts
+      mapping[numNonZero] = ((uint64_t)histogram[i] << 32) | i;
+      numNonZero += histogram[i] != 0;
+    }
+
+    // no symbols at all
+    if (numNonZero == 0)
+      return 0;
+
+    sort(mapping, numNonZero);
+
+    // extract ascendingly ordered histogram
+    unsigned int sorted[NumCodes];
+    for (unsigned int i = 0; i < numNonZero; i++)
+      sorted[i] = (unsigned int)(mapping[i] >> 32);
+
+    unsigned char result = Algorithm::template sortedInPlace<NumCodes, MaxLength>(numNonZero, sorted);
+    if (result == 0)
+      return 0;
+
+    // restore original order
+    for (unsigned int i = 0; i < numNonZero; i++)
+      codeLengths[(unsigned int)mapping[i]] = (unsigned char)sorted[i];
+
+    return result;
+  }
+
+private:
+  /// sort ascendingly
+  static void sort(uint64_t data[], unsigned int numElements)
+  {
+    // tiny alphabets: insertion sort beats everything else
+    if (NumCodes <= 32)
+    {
+      for (unsigned int i = 1; i < numElements; i++)
+      {
+        uint64_t current = data[i];
+        unsigned int j = i;
+        for (; j > 0 && data[j - 1] > current; j--)
+          data[j] = data[j - 1];
+        data[j] = current;
+      }
+    }
+    else
+      std::sort(data, data + numElements);
+  }
+};
+
+
+// ---------- common alphabets ----------
+
+/// DEFLATE: code length alphabet, 19 symbols, at most 7 bits
+typedef LengthLimiter< 19,  7> LengthLimiterDeflateCodeLengths;
+/// DEFLATE: distances, 30 symbols, at most 15 bits
+typedef LengthLimiter< 30, 15> LengthLimiterDeflateDistances;
+/// DEFLATE: literals and lengths, 286 symbols, at most 15 bits
+typedef LengthLimiter<286, 15> LengthLimiterDeflateLiterals;
+/// DEFLATE: literals and lengths including the two reserved symbols, 288 symbols, at most 15 bits
+typedef LengthLimiter<288, 15> LengthLimiterDeflateLiteralsReserved;
+/// JPEG/bytes: 256 symbols, at most 16 bits
+typedef LengthLimiter<256, 16> LengthLimiterJpeg;
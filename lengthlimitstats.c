@@ -0,0 +1,49 @@
+// //////////////////////////////////////////////////////////
+// lengthlimitstats.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "lengthlimitstats.h"
+
+
+#ifdef LENGTHLIMIT_STATS
+// each thread has its own counters, no need for locking
+#if defined(__GNUC__)
+__thread LengthLimitStats lengthLimitStatsCurrent;
+#else
+LengthLimitStats lengthLimitStatsCurrent;
+#endif
+#endif
+
+
+/// set all counters of the current thread to zero
+void lengthLimitStatsReset(void)
+{
+#ifdef LENGTHLIMIT_STATS
+  LengthLimitStats empty = { 0, 0, 0, 0, 0, 0 };
+  lengthLimitStatsCurrent = empty;
+#endif
+}
+
+
+/// counters of the current thread since the last reset
+LengthLimitStats lengthLimitStatsGet(void)
+{
+#ifdef LENGTHLIMIT_STATS
+  return lengthLimitStatsCurrent;
+#else
+  LengthLimitStats empty = { 0, 0, 0, 0, 0, 0 };
+  return empty;
+#endif
+}
+
+
+/// 1 if the library was compiled with LENGTHLIMIT_STATS, else 0
+int lengthLimitStatsEnabled(void)
+{
+#ifdef LENGTHLIMIT_STATS
+  return 1;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,65 @@
+// //////////////////////////////////////////////////////////
+// lengthlimitstats.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// why is a certain histogram slow ? count what the algorithms are doing internally:
+// - enabled by #define LENGTHLIMIT_STATS (or: make STATS=1) while compiling the library
+// - disabled by default: all counters are compiled out and lengthLimitStatsGet() returns zeros
+// - counters are thread-local (if supported by the compiler) and accumulate until lengthLimitStatsReset()
+// - functions which start their own threads (multiTable with numThreads > 1) only report what ran in the calling thread:
+//   the counters of worker threads are lost when these threads end
+// - example:
+//   lengthLimitStatsReset();
+//   packageMerge(15, 256, histogram, codeLengths);
+//   LengthLimitStats stats = lengthLimitStatsGet();
+
+/// counters shared by all length-limiting algorithms
+typedef struct
+{
+  /// main loop iterations: package-merge levels, JPEG/MiniZ code moves, BZip2 rescaled Huffman builds, Kraft threshold passes
+  unsigned long long iterations;
+  /// insertions and removals of limitedKraftHeap's heap
+  unsigned long long heapOperations;
+  /// invocations of moffatSortedInPlace(), including those by other algorithms (fast paths, BZip2, JPEG/MiniZ)
+  unsigned long long moffatCalls;
+  /// number of package-merge runs which stopped before the last level because nothing changed anymore
+  unsigned long long earlyExits;
+  /// sum of the levels where package-merge stopped early (divide by earlyExits to get the average)
+  unsigned long long earlyExitLevels;
+  /// total size of all heap allocations in bytes
+  unsigned long long bytesAllocated;
+} LengthLimitStats;
+
+/// set all counters of the current thread to zero
+void lengthLimitStatsReset(void);
+
+/// counters of the current thread since the last reset
+LengthLimitStats lengthLimitStatsGet(void);
+
+/// 1 if the library was compiled with LENGTHLIMIT_STATS, else 0
+int lengthLimitStatsEnabled(void);
+
+
+// ----- internal: used by the library's source code only -----
+
+#ifdef LENGTHLIMIT_STATS
+#if defined(__GNUC__)
+extern __thread LengthLimitStats lengthLimitStatsCurrent;
+#else
+extern LengthLimitStats lengthLimitStatsCurrent;
+#endif
+#define LENGTHLIMIT_COUNT(counter, amount) (lengthLimitStatsCurrent.counter += (amount))
+#else
+#define LENGTHLIMIT_COUNT(counter, amount) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,262 @@
+// //////////////////////////////////////////////////////////
+// limitedauto.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "limitedauto.h"
+
+#include "moffat.h"             // unlimited Huffman codes
+#include "packagemerge.h"       // optimal length-limited codes
+#include "limitedjpegdeflate.h" // fast adjustment of Huffman codes
+#include "limitedkraftheap.h"   // even faster but less efficient
+#include "lengthlimitstats.h"   // LENGTHLIMIT_COUNT
+#include <stdlib.h>             // malloc/free/qsort
+
+
+// thresholds were calibrated with the benchmark's corpus mode (64k blocks of text files, source code, binaries):
+// - limitedKraftHeap is by far the fastest algorithm
+// - its loss compared to package-merge was below 1.8% for all histograms where
+//   the most frequent symbol had a probability of less than 1/3
+// - but it was sometimes way above 2% for more skewed histograms
+//   (because it can't assign less than 1 bit to a symbol whose entropy is well below 1 bit)
+// - but measured against the budget it was rarely good enough for short codes: only 20 of 739 histograms
+//   stayed within 2% at 8 bits, at least 94% of them did at 11+ bits
+// - it almost never stayed within the budget if the symbols whose Huffman codes exceed maxLength
+//   had a total probability of more than 5x the budget
+// - these thresholds only decide whether limitedKraftHeap is worth a try, its loss is always measured
+#define KRAFTHEAP_MIN_BUDGET  0.02
+#define KRAFTHEAP_MAX_SKEW    3
+#define KRAFTHEAP_MAX_TOOLONG 5
+// - MiniZ's loss stayed within the budget only if the symbols whose Huffman codes exceed maxLength
+//   had a total probability of less than 5.4x the budget (0.1% budget, 8..15 bits)
+// - if their total probability is far above then skip MiniZ and go straight to package-merge
+#define MINIZ_MAX_TOOLONG     10
+
+
+// the following code shares many parts with the function moffat() in moffat.c
+
+
+// helper struct for qsort()
+struct KeyValue
+{
+  unsigned int key;
+  unsigned int value;
+};
+// helper function for qsort()
+static int compareKeyValue(const void* a, const void* b)
+{
+  struct KeyValue* aa = (struct KeyValue*) a;
+  struct KeyValue* bb = (struct KeyValue*) b;
+  // negative if a < b, zero if a == b, positive if a > b
+  if (aa->key < bb->key)
+    return -1;
+  if (aa->key > bb->key)
+    return +1;
+  return 0;
+}
+
+
+/// pick the fastest length-limiting algorithm whose compression loss doesn't exceed a given budget
+/** - histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+ *  - the function rejects maxLength > 63 but I don't see any practical reasons you would need a larger limit ...
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram  how often each code/symbol was found
+ *  @param  codeLength [out] computed code lengths
+ *  @param  budget     acceptable compression loss compared to optimal code lengths, e.g. 0.001 = 0.1%, 0 => always optimal
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedAuto(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[], double budget)
+{
+  // reject invalid input
+  if (maxLength == 0 || maxLength > 63 || numCodes == 0)
+    return 0;
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  // ----- cheap features -----
+  unsigned int       numNonZero   = 0;
+  unsigned long long sumHistogram = 0;
+  unsigned int       minHistogram = 0;
+  unsigned int       maxHistogram = 0;
+  for (i = 0; i < numCodes; i++)
+  {
+    if (histogram[i] == 0)
+      continue;
+
+    numNonZero++;
+    sumHistogram += histogram[i];
+    if (minHistogram > histogram[i] || minHistogram == 0)
+      minHistogram = histogram[i];
+    if (maxHistogram < histogram[i])
+      maxHistogram = histogram[i];
+  }
+
+  // reject an empty alphabet because malloc(0) is undefined
+  if (numNonZero == 0)
+    return 0;
+  // at least log2(numNonZero) bits required for every valid prefix code
+  if (maxLength < 63 && (1ULL << maxLength) < numNonZero)
+    return 0;
+
+  // 1. unlimited Huffman codes are short enough
+  if (moffatFitsLength(maxLength, sumHistogram, minHistogram))
+    return moffat(numCodes, histogram, codeLengths);
+
+  // initialize output
+  if (numNonZero < numCodes)
+    for (i = 0; i < numCodes; i++)
+      codeLengths[i] = 0;
+
+  // allocate a buffer for sorting the histogram
+  struct KeyValue* mapping = (struct KeyValue*) malloc(sizeof(struct KeyValue) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct KeyValue) * numNonZero);
+  // copy histogram to that buffer
+  unsigned int storeAt = 0;
+  for (i = 0; i < numCodes; i++)
+  {
+    // skip zeros
+    if (histogram[i] == 0)
+      continue;
+
+    mapping[storeAt].key   = histogram[i];
+    mapping[storeAt].value = i;
+    storeAt++;
+  }
+  // now storeAt == numNonZero
+
+  // invoke C standard library's qsort
+  qsort(mapping, numNonZero, sizeof(struct KeyValue), compareKeyValue);
+
+  // extract ascendingly ordered histogram
+  unsigned int* sorted = (unsigned int*) malloc(sizeof(unsigned int) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numNonZero);
+  for (i = 0; i < numNonZero; i++)
+    sorted[i] = mapping[i].key;
+
+  // 2. run Moffat algorithm, only the number of codes per code length is needed
+  unsigned int histNumBits[64];
+  unsigned char result = moffatSortedHistNumBits(numNonZero, sorted, histNumBits);
+
+  // Huffman codes already match the maxLength requirement ?
+  if (result > 0 && result <= maxLength)
+  {
+    // code lengths are in descending order
+    unsigned char reduce = result;
+    for (i = 0; i < numNonZero; i++)
+    {
+      codeLengths[mapping[i].value] = reduce;
+      histNumBits[reduce]--;
+      while (histNumBits[reduce] == 0 && reduce > 0)
+        reduce--;
+    }
+
+    free(sorted);
+    free(mapping);
+    return result;
+  }
+
+  // MiniZ is only worth a try if the codes that are too long are rare enough
+  unsigned int numTooLong = 0;
+  for (i = maxLength + 1; i <= result; i++)
+    numTooLong += histNumBits[i];
+  // the least frequent symbols have the longest codes
+  unsigned long long weightTooLong = 0;
+  for (i = 0; i < numTooLong; i++)
+    weightTooLong += mapping[i].key;
+
+  int tryKraftHeap = result > 0 && budget >= KRAFTHEAP_MIN_BUDGET && maxHistogram * (unsigned long long)KRAFTHEAP_MAX_SKEW < sumHistogram &&
+                     weightTooLong <= KRAFTHEAP_MAX_TOOLONG * budget * sumHistogram;
+  int tryMiniz     = result > 0 && weightTooLong <= MINIZ_MAX_TOOLONG * budget * sumHistogram;
+
+  // cost of unlimited Huffman codes: they are at least as good as optimal length-limited codes
+  // => if an algorithm's loss is acceptable compared to them then it's acceptable compared to the optimum, too
+  //    (Moffat's result is 0 only for code lengths above 63 bits, then there's no lower bound and only package-merge is used)
+  unsigned long long costUnlimited = 0;
+  if (tryKraftHeap || tryMiniz)
+  {
+    unsigned int histUnlimited[64];
+    for (i = 0; i < 64; i++)
+      histUnlimited[i] = histNumBits[i];
+
+    // code lengths are in descending order
+    unsigned char reduce = result;
+    for (i = 0; i < numNonZero; i++)
+    {
+      costUnlimited += reduce * (unsigned long long) mapping[i].key;
+      histUnlimited[reduce]--;
+      while (histUnlimited[reduce] == 0 && reduce > 0)
+        reduce--;
+    }
+  }
+
+  // 3. fastest algorithm if the caller doesn't care much about efficiency, but its loss must be measured
+  if (tryKraftHeap)
+  {
+    unsigned char limited = limitedKraftHeap(maxLength, numCodes, histogram, codeLengths);
+    if (limited > 0)
+    {
+      unsigned long long costLimited = 0;
+      for (i = 0; i < numNonZero; i++)
+        costLimited += codeLengths[mapping[i].value] * (unsigned long long) mapping[i].key;
+
+      if (costLimited - costUnlimited <= budget * costUnlimited)
+      {
+        free(sorted);
+        free(mapping);
+        return limited;
+      }
+    }
+  }
+
+  // 4. adjust with MiniZ's algorithm
+  if (tryMiniz)
+  {
+    unsigned int histLimited[64];
+    for (i = 0; i < 64; i++)
+      histLimited[i] = histNumBits[i];
+
+    unsigned char limited = limitedMinizInPlace(maxLength, result, histLimited);
+    if (limited > 0)
+    {
+      // assign MiniZ's code lengths (in descending order) and compute their cost
+      unsigned long long costLimited = 0;
+      unsigned char reduce = limited;
+      for (i = 0; i < numNonZero; i++)
+      {
+        codeLengths[mapping[i].value] = reduce;
+        costLimited += reduce * (unsigned long long) mapping[i].key;
+
+        // prepare next code length
+        histLimited[reduce]--;
+        while (histLimited[reduce] == 0 && reduce > 0)
+          reduce--;
+      }
+
+      if (costLimited - costUnlimited <= budget * costUnlimited)
+      {
+        free(sorted);
+        free(mapping);
+        return limited;
+      }
+    }
+  }
+
+  // 5. optimal code lengths, need to restore the sorted histogram (was overwritten by Moffat's algorithm)
+  for (i = 0; i < numNonZero; i++)
+    sorted[i] = mapping[i].key;
+
+  // Moffat's algorithm already told us that length-limiting is necessary, don't run it again
+  result = packageMergeSortedInPlaceNoFastPath(maxLength, numNonZero, sorted);
+
+  // "unsort" code lengths
+  for (i = 0; i < numNonZero; i++)
+    codeLengths[mapping[i].value] = sorted[i];
+
+  // let it go ...
+  free(sorted);
+  free(mapping);
+
+  return result;
+}
@@ -0,0 +1,35 @@
+// //////////////////////////////////////////////////////////
+// limitedauto.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// pick the fastest length-limiting algorithm whose compression loss doesn't exceed a given budget
+/** - histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+ *  - the decision is based on cheap features of the histogram (number of used symbols, skew, Fibonacci bound)
+ *    and the result of Moffat's unlimited Huffman codes:
+ *    1. if unlimited Huffman codes are guaranteed to fit into maxLength bits then Moffat's algorithm is used
+ *    2. if the budget is large and the histogram isn't skewed then limitedKraftHeap is used
+ *    3. if Moffat's codes fit into maxLength bits then they are returned directly
+ *    4. if MiniZ's adjustment of Moffat's codes stays within the budget then it is returned
+ *    5. else package-merge computes the optimal code lengths
+ *  - the loss of step 4 is measured against the unlimited Huffman code (a lower bound of the optimum),
+ *    therefore its result is always within the budget
+ *  - the function rejects maxLength > 63 but I don't see any practical reasons you would need a larger limit ...
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram  how often each code/symbol was found
+ *  @param  codeLength [out] computed code lengths
+ *  @param  budget     acceptable compression loss compared to optimal code lengths, e.g. 0.001 = 0.1%, 0 => always optimal
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedAuto(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[], double budget);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,7 @@
 #include "limitedbzip2.h"
 
 #include "moffat.h" // compute unlimited Huffman code lengths
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
 #include <stdlib.h> // malloc/free/qsort
 
 
@@ -29,15 +30,240 @@ static int compareKeyValue(const void* a, const void* b)
 }
 
 
-/// adjust bit lengths based on the algorithm found in bzip2's sources
+// after that many scaling steps all weights have converged (at most 32 bits can be shifted out)
+#define MAX_SCALE 40
+
+
+// ----- local helper functions -----
+
+/// more or less divide a weight by divideBy while avoiding zero
+static unsigned int scaleWeight(unsigned int weight, unsigned char extraShift, unsigned int divideBy)
+{
+  // bzip2 "clears" the lowest 8 bits of the histogram (extraShift = 8)
+  // to reach the length limit in less iterations
+  // but sacrifices lots of efficiency
+  // if you set extraShift to 0 then the code may need more iterations
+  // but finds much better code lengths
+  weight >>= extraShift;
+
+  // sometimes dividing the weight by a bigger integer (e.g. 3)
+  // may lead to more efficient prefix codes
+
+  // adding 1 avoids zero
+  weight   = 1 + (weight / divideBy);
+  weight <<= extraShift;
+
+  return weight;
+}
+
+/// integer part of log2(x), 0 if x is 0
+static unsigned char log2Floor(unsigned long long x)
+{
+  unsigned char result = 0;
+  while (x > 1)
+  {
+    x >>= 1;
+    result++;
+  }
+  return result;
+}
+
+
+// ----- and now externally visible code -----
+
+
+/// same as limitedBzip2 but scaling can be customized and the histogram must be sorted
+/** - histogram must be in ascending order and no entry must be zero
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of A
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @param  extraShift bzip2 uses 8, my default is 0
+ *  @param  divideBy   bzip2 and my default use 2
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedBzip2CustomSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[],
+                                              unsigned char extraShift, unsigned int divideBy)
+{
+  // reject invalid input
+  if (maxLength == 0 || numCodes == 0 || divideBy < 2 || extraShift > 16)
+    return 0;
+  // at least log2(numCodes) bits required for every valid prefix code, otherwise scaling would never succeed
+  if (maxLength < 32 && (1U << maxLength) < numCodes)
+    return 0;
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  // scaled weights are computed on demand: row k contains all weights scaled k times
+  // (Moffat's algorithm overwrites A, therefore row 0 keeps a copy of the original weights)
+  unsigned int  numRows = 1;
+  unsigned int* scaled  = (unsigned int*) malloc(sizeof(unsigned int) * numCodes);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numCodes);
+  for (i = 0; i < numCodes; i++)
+    scaled[i] = A[i];
+
+  // run Moffat algorithm ...
+  unsigned char result = moffatSortedInPlace(numCodes, A);
+
+  // ... until a proper maximum code length is found
+  // bzip2 scales all weights and re-runs Moffat's algorithm until the code lengths are short enough,
+  // each iteration is a full Huffman build
+  // => predict the number of scaling steps, then search for the smallest number of steps
+  //    (same result as bzip2's loop unless the code length isn't monotonic in the number of steps)
+  if (result > maxLength)
+  {
+    // ----- prediction -----
+    // a leaf's depth is roughly log2(sumHistogram / its weight):
+    // since the two smallest weights end up as siblings, their sum determines the depth of the longest codes
+    // - scaling is monotonic, the smallest weights remain the smallest weights
+    // - the estimate isn't precise but its error changes only slowly while scaling
+    unsigned long long sumHistogram = 0;
+    for (i = 0; i < numCodes; i++)
+      sumHistogram += scaled[i];
+    unsigned int smallest = scaled[0];
+    unsigned int second   = scaled[numCodes > 1 ? 1 : 0];
+
+    unsigned char estimateUnscaled = log2Floor(sumHistogram / (smallest + (unsigned long long)second));
+    unsigned int  numScale  = 0;
+    unsigned char predicted = result;
+    while (predicted > maxLength && numScale < MAX_SCALE)
+    {
+      numScale++;
+
+      // the sum of all scaled weights is at most (sum / divideBy + numCodes), that upper bound is good enough
+      sumHistogram = (((sumHistogram >> extraShift) / divideBy) + numCodes) << extraShift;
+      smallest     = scaleWeight(smallest, extraShift, divideBy);
+      second       = scaleWeight(second,   extraShift, divideBy);
+
+      // Fibonacci bound guarantees that no more scaling steps are needed
+      if (moffatFitsLength(maxLength, sumHistogram, smallest))
+        break;
+
+      // assume that the longest codes become as much shorter as the estimate
+      unsigned char estimateScaled = log2Floor(sumHistogram / (smallest + (unsigned long long)second));
+      if (estimateScaled < estimateUnscaled)
+        predicted = result - (estimateUnscaled - estimateScaled);
+    }
+
+    // estimate never became short enough (e.g. almost 2^maxLength symbols) => no useful prediction
+    if (predicted > maxLength)
+      numScale = 1;
+
+    // ----- search -----
+    // two buffers: the latest attempt and the best valid code lengths found so far
+    unsigned int* sorted = A;
+    unsigned int* best   = (unsigned int*) malloc(sizeof(unsigned int) * numCodes);
+    LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numCodes);
+
+    // bracket the smallest number of scaling steps where the code lengths are short enough:
+    // - tooFew = largest number of steps known to produce too long codes
+    // - enough = smallest number of steps known to produce short enough codes, 0 if unknown yet
+    // start with the prediction, then galloping search until the bracket is found, then binary search
+    unsigned int tooFew = 0;
+    unsigned int enough = 0;
+    unsigned int step   = 1;
+    while (enough != tooFew + 1)
+    {
+      // compute missing rows
+      if (numScale >= numRows)
+      {
+        scaled = (unsigned int*) realloc(scaled, sizeof(unsigned int) * numCodes * (numScale + 1));
+        LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numCodes * (numScale + 1 - numRows));
+        for (; numRows <= numScale; numRows++)
+        {
+          const unsigned int* previous = scaled + (numRows - 1) * numCodes;
+          unsigned int*       current  = scaled +  numRows      * numCodes;
+          for (i = 0; i < numCodes; i++)
+            current[i] = scaleWeight(previous[i], extraShift, divideBy);
+        }
+      }
+
+      LENGTHLIMIT_COUNT(iterations, 1);
+
+      // again: run Moffat algorithm (sorted is overwritten with code lengths)
+      const unsigned int* weights = scaled + numScale * numCodes;
+      for (i = 0; i < numCodes; i++)
+        sorted[i] = weights[i];
+      unsigned char current = moffatSortedInPlace(numCodes, sorted);
+
+      if (current <= maxLength)
+      {
+        // keep these code lengths
+        unsigned int* swap = best; best = sorted; sorted = swap;
+        result = current;
+        enough = numScale;
+      }
+      else
+        tooFew = numScale;
+
+      // next number of steps
+      if (enough == 0)
+      {
+        // all weights converged but codes are still too long => give up
+        if (tooFew >= MAX_SCALE)
+        {
+          free(sorted == A ? best : sorted);
+          free(scaled);
+          return 0;
+        }
+
+        // prediction was too optimistic
+        numScale = tooFew + step;
+        if (numScale > MAX_SCALE)
+          numScale = MAX_SCALE;
+      }
+      else
+      {
+        // prediction was too pessimistic
+        if (enough > tooFew + step)
+          numScale = enough - step;
+        else
+          numScale = tooFew + (enough - tooFew) / 2;
+      }
+      step *= 2;
+    }
+
+    // code lengths of the best attempt must be stored in A
+    if (best != A)
+    {
+      for (i = 0; i < numCodes; i++)
+        A[i] = best[i];
+      free(best);
+    }
+    else
+      free(sorted);
+  }
+
+  free(scaled);
+  return result;
+}
+
+
+/// same as limitedBzip2 but the histogram must be sorted
+/** - histogram must be in ascending order and no entry must be zero
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of A
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedBzip2SortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+{
+  return limitedBzip2CustomSortedInPlace(maxLength, numCodes, A, 0, 2);
+}
+
+
+/// same as limitedBzip2 but scaling can be customized
 /** - histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
  *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
  *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
  *  @param  histogram  how often each code/symbol was found
  *  @param  codeLength [out] computed code lengths
+ *  @param  extraShift bzip2 uses 8, my default is 0
+ *  @param  divideBy   bzip2 and my default use 2
  *  @result actual maximum code length, 0 if error
  */
-unsigned char limitedBzip2(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+unsigned char limitedBzip2Custom(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[],
+                                 unsigned char extraShift, unsigned int divideBy)
 {
   // my allround variable for various loops
   unsigned int i;
@@ -59,6 +285,7 @@ unsigned char limitedBzip2(unsigned char maxLength, unsigned int numCodes, const
 
   // allocate a buffer for sorting the histogram
   struct KeyValue* mapping = (struct KeyValue*) malloc(sizeof(struct KeyValue) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct KeyValue) * numNonZero);
   // copy histogram to that buffer
   unsigned int storeAt = 0;
   for (i = 0; i < numCodes; i++)
@@ -78,54 +305,37 @@ unsigned char limitedBzip2(unsigned char maxLength, unsigned int numCodes, const
 
   // extract ascendingly ordered histogram
   unsigned int* sorted = (unsigned int*) malloc(sizeof(unsigned int) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numNonZero);
   for (i = 0; i < numNonZero; i++)
     sorted[i] = mapping[i].key;
 
-  // run Moffat algorithm ...
-  unsigned char result = moffatSortedInPlace(numNonZero, sorted);
-  // ... until a proper maximum code length is found
-  while (result > maxLength)
-  {
-    // more or less divide each weight by two while avoiding zero
-    for (i = 0; i < numNonZero; i++)
-    {
-      unsigned int weight = mapping[i].key;
-
-      // bzip2 "clears" the lowest 8 bits of the histogram
-      // to reach the length limit in less iterations
-      // but sacrifices lots of efficiency
-      // if you set EXTRA_SHIFT to 0 then the code may need more iterations
-      // but finds much better code lengths
-      //#define EXTRA_SHIFT 8
-      #define EXTRA_SHIFT 0
-
-      // sometimes dividing the weight by a bigger integer (e.g. 3)
-      // may lead to more efficient prefix codes
-      #define DIVIDE_BY   2
-
-      // the shifts do more harm than good in my opinion
-      weight >>= EXTRA_SHIFT;
-
-      // adding 1 avoids zero
-      weight   = 1 + (weight / DIVIDE_BY);
-      weight <<= EXTRA_SHIFT;
-
-      // sorted was overwritten with code lengths
-      mapping[i].key = sorted[i] = weight;
-    }
-
-    // again: run Moffat algorithm
-    result = moffatSortedInPlace(numNonZero, sorted);
-  }
+  // compute code lengths
+  unsigned char result = limitedBzip2CustomSortedInPlace(maxLength, numNonZero, sorted, extraShift, divideBy);
 
   // restore original order
-  for (i = 0; i < numNonZero; i++)
-    codeLengths[mapping[i].value] = sorted[i];
+  if (result > 0)
+    for (i = 0; i < numNonZero; i++)
+      codeLengths[mapping[i].value] = sorted[i];
 
   // let it go ...
   free(sorted);
   free(mapping);
 
   return result;
+}
+
 
+/// adjust bit lengths based on the algorithm found in bzip2's sources
+/** - histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram  how often each code/symbol was found
+ *  @param  codeLength [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedBzip2(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+{
+  // I found that an extra shift of 0 leads to much better code lengths than bzip2's 8
+  // and dividing by 2 is the best choice for most data sets
+  return limitedBzip2Custom(maxLength, numCodes, histogram, codeLengths, 0, 2);
 }
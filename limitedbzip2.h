@@ -6,9 +6,38 @@
 
 #pragma once
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /// adjust bit lengths based on the algorithm found in bzip2's sources
-/** - histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+/** - histogram must be in ascending order and no entry must be zero
+ *  - each scaling step keeps the histogram sorted, therefore it's sorted only once by the caller
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of A
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedBzip2SortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[]);
+
+/// same as limitedBzip2SortedInPlace but scaling can be customized
+/** - histogram must be in ascending order and no entry must be zero
+ *  - each scaling step computes weight = (1 + (weight >> extraShift) / divideBy) << extraShift
  *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of A
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @param  extraShift bzip2 uses 8, my default is 0
+ *  @param  divideBy   bzip2 and my default use 2, must be at least 2
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedBzip2CustomSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[],
+                                              unsigned char extraShift, unsigned int divideBy);
+
+
+// ---------- same algorithm with a more convenient interface ----------
+
+/// same as before but histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+/** @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
  *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
  *  @param  histogram  how often each code/symbol was found
  *  @param  codeLength [out] computed code lengths
@@ -16,6 +45,20 @@
  */
 unsigned char limitedBzip2(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
 
+/// same as limitedBzip2 but scaling can be customized
+/** - histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+ *  - each scaling step computes weight = (1 + (weight >> extraShift) / divideBy) << extraShift
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram  how often each code/symbol was found
+ *  @param  codeLength [out] computed code lengths
+ *  @param  extraShift bzip2 uses 8, my default is 0
+ *  @param  divideBy   bzip2 and my default use 2, must be at least 2
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedBzip2Custom(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[],
+                                 unsigned char extraShift, unsigned int divideBy);
+
 // the main idea is to adjust the histogram until the standard Huffman algorithm produces suitable code lengths
 // see https://github.com/Unidata/compression/blob/master/bzip2/huffman.c
 // => the "histogram adjustment" can be found @ lines 142-146:
@@ -27,3 +70,10 @@ unsigned char limitedBzip2(unsigned char maxLength, unsigned int numCodes, const
 // => shifting by 8 is a very fast way to get suitable length-limited prefix codes
 //    but often gives worse compression efficiency compared to other algorithms
 // => getting rid of the shift by 8 is still quite fast and produces much better results
+// => instead of scaling one step at a time, the number of scaling steps is predicted from the
+//    ratio of the total sum of all weights and the two smallest weights
+//    and then found by galloping/binary search, which usually needs fewer Huffman builds
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,7 @@
 #include "limitedjpegdeflate.h"
 
 #include "moffat.h" // compute unlimited Huffman code lengths for limitedImpl()
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
 #include <stdlib.h> // malloc/free/qsort
 
 
@@ -66,8 +67,25 @@ unsigned char limitedJpegInPlace(unsigned char newMaxLength, unsigned char oldMa
   // - therefore the sum of all Kraft values remains unchanged after the transformation
 
   // each step reduces the bit lengths of just two symbols by typically one bit
-  // => processing a huge alphabet with very large bit lengths can be quite slow
+  // => processing a huge alphabet with very large bit lengths would be quite slow
   //    (however, this situation is impossible with the small JPEG alphabet)
+  // the original loop of Annex K.3 looks like this:
+  //   while (i > newMaxLength)
+  //   {
+  //     if (histNumBits[i] == 0) { i--; continue; }
+  //     j = i - 2;
+  //     while (j > 0 && histNumBits[j] == 0)
+  //       j--;
+  //     histNumBits[i] -= 2; histNumBits[i - 1]++;
+  //     histNumBits[j + 1] += 2; histNumBits[j]--;
+  //   }
+  // my code produces identical results but transforms all pairs of the current bit length at once:
+  // - each pair needs a donor: the longest code which is at least two bits shorter (length j)
+  // - its two children (length j+1) will be the next donors, their children the donors after them, etc.
+  // - converting one donor of length j into codes of length i-1 that way takes 2^(i-1-j) - 1 pairs
+  //   and its net effect is: histNumBits[j]-- and histNumBits[i-1] += 2^(i-1-j)
+  // - if less pairs remain, then only one donor is processed and the search continues one bit longer
+  // - the number of codes at the longest bit length must be even (true for all complete prefix codes)
 
   if (newMaxLength <= 1)
     return 0;
@@ -75,6 +93,9 @@ unsigned char limitedJpegInPlace(unsigned char newMaxLength, unsigned char oldMa
     return 0;
   if (newMaxLength == oldMaxLength)
     return newMaxLength;
+  // an odd number of codes at the longest bit length can't be paired, the loop below would never finish
+  if (histNumBits[oldMaxLength] % 2 != 0)
+    return 0;
 
   // iterate over all "excessive" bit lengths, beginning with the longest
   unsigned char i = oldMaxLength;
@@ -86,23 +107,50 @@ unsigned char limitedJpegInPlace(unsigned char newMaxLength, unsigned char oldMa
       i--;
       continue;
     }
+    // same problem for incomplete prefix codes: they may have an odd number of codes at a shorter bit length, too
+    if (histNumBits[i] % 2 != 0)
+      return 0;
+
+    LENGTHLIMIT_COUNT(iterations, 1);
+
+    // all pairs become one bit shorter (their joint prefix) ...
+    unsigned int numPairs = histNumBits[i] / 2;
+    histNumBits[i]     -= 2 * numPairs;
+    histNumBits[i - 1] += numPairs;
+
+    // ... and each of them needs a donor
+    unsigned char target = i - 1;
+    unsigned char j      = i - 2;
+    while (numPairs > 0)
+    {
+      // look for codes that are at least two bits shorter
+      while (j > 0 && histNumBits[j] == 0)
+        j--;
+
+      // convert donors completely into codes of length i-1
+      if (j > 0)
+      {
+        unsigned long long chain = (1ULL << (target - j)) - 1;
+        unsigned long long numChains = numPairs / chain;
+        if (numChains > histNumBits[j])
+          numChains = histNumBits[j];
+        if (numChains > 0)
+        {
+          histNumBits[j]      -= (unsigned int) numChains;
+          histNumBits[target] += (unsigned int)(numChains << (target - j));
+          numPairs            -= (unsigned int)(numChains * chain);
+          continue;
+        }
+      }
 
-    // look for codes that are at least two bits shorter
-    unsigned char j = i - 2;
-    while (j > 0 && histNumBits[j] == 0)
-      j--;
-
-    // change bit length of 2 of the longest codes
-    histNumBits[i] -= 2;
-    // one code becomes one bit shorter
-    // (using the joint prefix of the old two codes)
-    histNumBits[i - 1]++;
-
-    // the other code has length j+1 now
-    // but another, not-yet-involved, code with length j
-    // is moved to bit length j+1 as well
-    histNumBits[j + 1] += 2;
-    histNumBits[j]--;
+      // not enough pairs left: process a single donor of length j,
+      // it moves to bit length j+1 as well as another code (the second code of a pair)
+      histNumBits[j + 1] += 2;
+      histNumBits[j]--;
+      numPairs--;
+      // the new codes will be the next donors
+      j++;
+    }
   }
 
   // return longest code length that is still used
@@ -112,6 +160,7 @@ unsigned char limitedJpegInPlace(unsigned char newMaxLength, unsigned char oldMa
   // JPEG Annex K.3 specifies an extra line:
   // histNumBits[i]--;
   // => because JPEG needs a special symbol to avoid 0xFF in its output stream
+  //    (jpegBuildTable() in jpegtables.c takes care of it)
 
   return i;
 }
@@ -161,34 +210,66 @@ unsigned char limitedMinizInPlace(unsigned char newMaxLength, unsigned char oldM
   for (i = newMaxLength; i > 0; i--)
     total += histNumBits[i] << (newMaxLength - i);
 
-  // iterate until Kraft sum doesn't exceed 1 anymore
-  unsigned long long one = 1ULL << newMaxLength;
-  while (total > one)
+  // MiniZ's original loop moves one code per iteration until the Kraft sum doesn't exceed 1 anymore:
+  //   while (total > one)
+  //   {
+  //     histNumBits[newMaxLength]--;
+  //     for (i = newMaxLength - 1; i > 0; i--)
+  //       if (histNumBits[i] > 0)
+  //       {
+  //         histNumBits[i]--;
+  //         histNumBits[i + 1] += 2;
+  //         break;
+  //       }
+  //     total--;
+  //   }
+  // => each iteration reduces the Kraft sum by exactly one unit, so there are "total - one" iterations
+  // => large alphabets clamped to a small limit may need thousands of iterations
+  // the following code produces identical results but processes lots of iterations at once:
+  // - the loop always picks the longest code shorter than newMaxLength, say length i
+  // - this code becomes two codes of length i+1 which will be picked next, their children next, etc.
+  //   until only codes of length newMaxLength are left
+  // - that whole chain needs 2^(newMaxLength - i) - 1 iterations
+  //   and its net effect is: histNumBits[i]-- and histNumBits[newMaxLength]++
+  // - if less iterations remain, then only the first step of the chain is performed
+  //   and the next codes are one bit longer
+  unsigned long long one    = 1ULL << newMaxLength;
+  unsigned long long excess = total > one ? total - one : 0;
+  i = newMaxLength - 1;
+  while (excess > 0)
   {
-    // select a code with maximum length, it will be moved
-    histNumBits[newMaxLength]--;
+    LENGTHLIMIT_COUNT(iterations, 1);
 
-    // find a second code with shorter length
-    for (i = newMaxLength - 1; i > 0; i--)
-      if (histNumBits[i] > 0)
-      {
-        histNumBits[i]--;
-        // extend that shorter code by one bit
-        // and assign the same code length to the selected one
-        histNumBits[i + 1] += 2;
-
-        // note: it's possible (and quite likely !) that the selected code
-        //       gets assigned the same code it had before
-        // example: - newMaxLength is 16 and you have codes with 15 bits, too
-        //          - you select a 16 bit code and pick a second 15 bit code
-        //          - that 15 bit code becomes a 16 bit code and
-        //            the 16 bit code stays a 16 bit code
-
-        break;
-      }
+    // find longest code which is shorter than newMaxLength
+    while (i > 0 && histNumBits[i] == 0)
+      i--;
+    // no such code (invalid input): only codes with maximum length are removed
+    if (i == 0)
+    {
+      histNumBits[newMaxLength] -= excess;
+      break;
+    }
 
-    // moving these codes reduced the Kraft sum
-    total--;
+    // complete chains
+    unsigned long long chain    = (1ULL << (newMaxLength - i)) - 1;
+    unsigned long long numChains = excess / chain;
+    if (numChains > histNumBits[i])
+      numChains = histNumBits[i];
+    if (numChains > 0)
+    {
+      histNumBits[i]            -= numChains;
+      histNumBits[newMaxLength] += numChains;
+      excess -= numChains * chain;
+      continue;
+    }
+
+    // not enough iterations left for a complete chain: just perform its first step
+    histNumBits[newMaxLength]--;
+    histNumBits[i]--;
+    histNumBits[i + 1] += 2;
+    excess--;
+    // continue with the new codes
+    i++;
   }
 
   return newMaxLength;
@@ -216,8 +297,54 @@ static int compareKeyValue(const void* a, const void* b)
 typedef unsigned char (*LimitedInPlace)(unsigned char newMaxLength, unsigned char oldMaxLength, unsigned int histNumBits[]);
 
 
+// shared by limitedImpl() and the public ...SortedInPlace() functions
+static unsigned char limitedSortedImpl(LimitedInPlace algorithm, unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+{
+  // reject invalid input
+  if (maxLength == 0 || maxLength > 63 || numCodes == 0)
+    return 0;
+
+  // run Moffat algorithm, but only count how many codes have a certain length
+  unsigned int histNumBits[64];
+  unsigned char maxLengthUnlimited = moffatSortedHistNumBits(numCodes, A, histNumBits);
+  // ----- until here the code was pretty much the same as moffat() -----
+
+  // at most 63 bits
+  if (maxLengthUnlimited == 0)
+    return 0;
+
+  // Huffman codes already match the maxLength requirement ?
+  unsigned char newMax = maxLengthUnlimited;
+  if (maxLengthUnlimited > maxLength)
+  {
+    // now reduce code length with JPEG/GZIP algorithm
+    newMax = algorithm(maxLength, maxLengthUnlimited, histNumBits);
+
+    // failed ?
+    if (newMax == 0)
+      return 0;
+  }
+
+  // code lengths are in descending order, assign them (the only pass over all symbols)
+  unsigned char reduce = newMax;
+  unsigned int i;
+  for (i = 0; i < numCodes; i++)
+  {
+    // assign longest available code length
+    A[i] = reduce;
+
+    // prepare next code length
+    histNumBits[reduce]--;
+    while (histNumBits[reduce] == 0 && reduce > 0)
+      reduce--;
+  }
+
+  return newMax;
+}
+
+
 // code is for limitedJpeg and limitedGzip would be 99% identical, they just call a differenz in-place algorithm
-unsigned char limitedImpl(LimitedInPlace algorithm, unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+static unsigned char limitedImpl(LimitedInPlace algorithm, unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
 {
   // reject invalid input
   if (maxLength == 0 || maxLength > 63 || numCodes == 0)
@@ -243,6 +370,7 @@ unsigned char limitedImpl(LimitedInPlace algorithm, unsigned char maxLength, uns
 
   // allocate a buffer for sorting the histogram
   struct KeyValue* mapping = (struct KeyValue*) malloc(sizeof(struct KeyValue) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct KeyValue) * numNonZero);
   // copy histogram to that buffer
   unsigned int storeAt = 0;
   for (i = 0; i < numCodes; i++)
@@ -262,63 +390,17 @@ unsigned char limitedImpl(LimitedInPlace algorithm, unsigned char maxLength, uns
 
   // extract ascendingly ordered histogram
   unsigned int* sorted = (unsigned int*) malloc(sizeof(unsigned int) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numNonZero);
   for (i = 0; i < numNonZero; i++)
     sorted[i] = mapping[i].key;
 
-  // run Moffat algorithm
-  unsigned char maxLengthUnlimited = moffatSortedInPlace(numNonZero, sorted);
-  // ----- until here the code was pretty much the same as moffat() -----
+  // compute code lengths of the sorted histogram
+  unsigned char newMax = limitedSortedImpl(algorithm, maxLength, numNonZero, sorted);
 
-  // Huffman codes already match the maxLength requirement ?
-  if (maxLengthUnlimited <= maxLength)
-  {
-    // restore original order
+  // code lengths are in descending order, assign them to the unsorted symbols
+  if (newMax != 0)
     for (i = 0; i < numNonZero; i++)
-      codeLengths[mapping[i].value] = sorted[i];
-
-    free(sorted);
-    free(mapping);
-    return maxLengthUnlimited;
-  }
-
-  // at most 63 bits
-  if (maxLengthUnlimited > 63)
-  {
-    free(sorted);
-    free(mapping);
-    return 0;
-  }
-
-  // histogram of code lengths
-  unsigned int histNumBits[64] = { 0 };
-  for (i = 0; i < numNonZero; i++)
-    histNumBits[sorted[i]]++;
-
-  // now reduce code length with JPEG/GZIP algorithm
-  unsigned char newMax = algorithm(maxLength, maxLengthUnlimited, histNumBits);
-
-  // failed ?
-  if (newMax == 0)
-  {
-    free(sorted);
-    free(mapping);
-    return 0;
-  }
-
-  // code lengths are in descending order, adjust them
-  unsigned char reduce = newMax;
-  for (i = 0; i < numNonZero; i++)
-  {
-    // find symbol associated to that code length
-    unsigned int unsorted = mapping[i].value;
-    // assign longest available code length
-    codeLengths[unsorted] = reduce;
-
-    // prepare next code length
-    histNumBits[reduce]--;
-    while (histNumBits[reduce] == 0)
-      reduce--;
-  }
+      codeLengths[mapping[i].value] = (unsigned char) sorted[i];
 
   // let it go ...
   free(sorted);
@@ -354,3 +436,27 @@ unsigned char limitedMiniz(unsigned char maxLength, unsigned int numCodes, const
 {
   return limitedImpl(limitedMinizInPlace, maxLength, numCodes, histogram, codeLengths);
 }
+
+
+/// same as limitedJpeg but histogram must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+/** @param  maxLength  maximum code length, e.g. 15 for JPEG
+ *  @param  numCodes   number of codes
+ *  @param  A          [in] how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedJpegSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+{
+  return limitedSortedImpl(limitedJpegInPlace, maxLength, numCodes, A);
+}
+
+
+/// same as limitedMiniz but histogram must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+/** @param  maxLength  maximum code length, e.g. 15 for DEFLATE
+ *  @param  numCodes   number of codes
+ *  @param  A          [in] how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedMinizSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+{
+  return limitedSortedImpl(limitedMinizInPlace, maxLength, numCodes, A);
+}
@@ -6,6 +6,10 @@
 
 #pragma once
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // this file contains two very similar length-limiting algorithm:
 // 1. the procedure described in JPEG Annex K.3
 // 2. the technique found in MiniZ's source code
@@ -18,6 +22,8 @@
  *  - maxLength must be a bit length where a prefix code exists
  *    => that means there are no more than 2^maxLength symbols
  *    => which is the same as sum(histNumBits) <= 2^maxLength
+ *  - the number of codes with the longest bit length must be even (true for all complete prefix codes, e.g. Huffman codes),
+ *    the function returns 0 if it's odd
  *  - not much error checking, invalid input can easily crash the code
  *  - example: assume you generated a prefix code with the following bit lengths
  *             symbol A needs 1 bit, B isn't used (0 bits), C needs 2 bits, D 3 bits, E 4 bits, F and G need 5 bits each
@@ -78,3 +84,23 @@ unsigned char limitedJpeg(unsigned char maxLength, unsigned int numCodes, const
  *  @result actual maximum code length, 0 if error
  */
 unsigned char limitedMiniz(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+/// same as limitedJpeg but histogram must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+/** @param  maxLength  maximum code length, e.g. 15 for JPEG
+ *  @param  numCodes   number of codes
+ *  @param  A          [in] how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedJpegSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[]);
+
+/// same as limitedMiniz but histogram must be sorted ascendingly and must not contain zeros, will be overwritten by code lengths
+/** @param  maxLength  maximum code length, e.g. 15 for DEFLATE
+ *  @param  numCodes   number of codes
+ *  @param  A          [in] how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char limitedMinizSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[]);
+
+#ifdef __cplusplus
+}
+#endif
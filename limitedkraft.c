@@ -6,6 +6,7 @@
 
 #include "limitedkraft.h"
 
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
 #include <stdint.h> // int32_t
 
 
@@ -161,6 +162,9 @@ unsigned char limitedKraft(unsigned char maxLength, unsigned int numCodes, const
   // iterate until Kraft inequality is satisfied
   float threshold;
   for (threshold = INITIAL_THRESHOLD; spent > one; threshold -= STEP_THRESHOLD)
+  {
+    LENGTHLIMIT_COUNT(iterations, 1);
+
     for (i = 0; i < numCodes; i++)
     {
       // all valid codes except those already at maximum length
@@ -181,6 +185,7 @@ unsigned char limitedKraft(unsigned char maxLength, unsigned int numCodes, const
           break;
       }
     }
+  }
 
   // optional: Kraft sum is below one, therefore a few codes might become shorter
   // this step can be skipped, we already have created a (suboptimal) prefix code
@@ -5,6 +5,8 @@
 //
 
 #include "limitedkraftheap.h"
+#include "multiversion.h" // HOT_FUNCTION
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
 #include <stdlib.h> // malloc/free
 #include <stdint.h> // int32_t
 
@@ -94,6 +96,8 @@ static void heap_sinkDown(Heap* heap, size_t current)
 /// erase largest key (top of the heap) and its values
 static void heap_removeTop(Heap* heap)
 {
+  LENGTHLIMIT_COUNT(heapOperations, 1);
+
   // shrink by one
   heap->size--;
 
@@ -112,6 +116,8 @@ static void heap_removeTop(Heap* heap)
 /// add an item to the heap
 static void heap_insert(Heap* heap, Key key, Value value)
 {
+  LENGTHLIMIT_COUNT(heapOperations, 1);
+
   // append at the end
   heap->keys  [heap->size] = key;
   heap->values[heap->size] = value;
@@ -215,6 +221,7 @@ static float fastlog2(float x)
  *  @param  codeLength [out] computed code lengths
  *  @result actual maximum code length, 0 if error
  */
+HOT_FUNCTION // heap operations are inlined, therefore they are multiversioned, too
 unsigned char limitedKraftHeap(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
 {
   // my allround variable for various loops
@@ -240,6 +247,7 @@ unsigned char limitedKraftHeap(unsigned char maxLength, unsigned int numCodes, c
   heap.size = 0;
   heap.keys   = (float*)        malloc(numCodes * sizeof(float));
   heap.values = (unsigned int*) malloc(numCodes * sizeof(unsigned int));
+  LENGTHLIMIT_COUNT(bytesAllocated, numCodes * (sizeof(float) + sizeof(unsigned int)));
 
   // start with rounded optimal code length
   for (i = 0; i < numCodes; i++)
@@ -284,6 +292,8 @@ unsigned char limitedKraftHeap(unsigned char maxLength, unsigned int numCodes, c
   // iterate until Kraft inequality is satisfied
   while (spent > one)
   {
+    LENGTHLIMIT_COUNT(iterations, 1);
+
     // extract code with largest gain (theoretical entropy minus code length)
     float        gain = heap.keys  [0];
     unsigned int code = heap.values[0];
@@ -6,6 +6,10 @@
 
 #pragma once
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /// create prefix code lengths solely by optimizing the Kraft inequality
 /**
  *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
@@ -15,3 +19,7 @@
  *  @result actual maximum code length, 0 if error
  */
 unsigned char limitedKraftHeap(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,29 +5,19 @@
 //
 
 #include "moffat.h"
+#include "multiversion.h" // HOT_FUNCTION
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
 #include <stdlib.h> // malloc/free/qsort
 
 
-/// compute prefix code ("Huffman code") based on Moffat's in-place algorithm
-/** histogram must be in ascending order and no entry must be zero
+/// phase 1 and 2 of Moffat's in-place algorithm: depths of all internal nodes
+/** - histogram must be in ascending order and no entry must be zero, at least two codes
+ *  - afterwards A[0 ... numCodes - 2] contains the depths of the internal nodes (in ascending order of their weights)
  *  @param  numCodes number of elements
- *  @param  A [in]   how often each code/symbol was found [out] computed code lengths
- *  @result maximum code length, 0 if error
+ *  @param  A [in]   how often each code/symbol was found [out] depths of internal nodes
  */
-unsigned char moffatSortedInPlace(unsigned int numCodes, unsigned int A[])
+static void buildTree(unsigned int numCodes, unsigned int A[])
 {
-  // based on page 61/90: https://www.cs.brandeis.edu/~dcc/Programs/Program2015KeynoteSlides-Moffat.pdf
-  // see also             https://people.eng.unimelb.edu.au/ammoffat/inplace.c
-
-  // handle two pathological cases
-  if (numCodes <= 0)
-    return 0;
-  if (numCodes == 1)
-  {
-    A[0] = 1; // Moffat's code sets A[0] = 0
-    return 1;
-  }
-
   // phase 1
   unsigned int leaf = 0;
   unsigned int root = 0;
@@ -66,6 +56,34 @@ unsigned char moffatSortedInPlace(unsigned int numCodes, unsigned int A[])
   int j;
   for (j = numCodes - 3; j >= 0; j--)
     A[j] = A[A[j]] + 1;
+}
+
+
+/// compute prefix code ("Huffman code") based on Moffat's in-place algorithm
+/** histogram must be in ascending order and no entry must be zero
+ *  @param  numCodes number of elements
+ *  @param  A [in]   how often each code/symbol was found [out] computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+HOT_FUNCTION
+unsigned char moffatSortedInPlace(unsigned int numCodes, unsigned int A[])
+{
+  // based on page 61/90: https://www.cs.brandeis.edu/~dcc/Programs/Program2015KeynoteSlides-Moffat.pdf
+  // see also             https://people.eng.unimelb.edu.au/ammoffat/inplace.c
+
+  LENGTHLIMIT_COUNT(moffatCalls, 1);
+
+  // handle two pathological cases
+  if (numCodes <= 0)
+    return 0;
+  if (numCodes == 1)
+  {
+    A[0] = 1; // Moffat's code sets A[0] = 0
+    return 1;
+  }
+
+  // phase 1 and 2
+  buildTree(numCodes, A);
 
   // phase 3
   unsigned int  avail = 1;
@@ -73,7 +91,7 @@ unsigned char moffatSortedInPlace(unsigned int numCodes, unsigned int A[])
   unsigned char depth = 0;
 
   int root2 = (int)numCodes - 2;
-  next = numCodes - 1;
+  unsigned int next = numCodes - 1;
   while (avail > 0)
   {
     while (root2 >= 0 && A[root2] == depth)
@@ -98,6 +116,350 @@ unsigned char moffatSortedInPlace(unsigned int numCodes, unsigned int A[])
 }
 
 
+/// same as moffatSortedInPlace() but returns only the number of codes for each code length
+/** histogram must be in ascending order and no entry must be zero
+ *  @param  numCodes    number of elements
+ *  @param  A           [in] how often each code/symbol was found [out] undefined
+ *  @param  histNumBits [out] histogram of code lengths, must have 64 elements
+ *  @result maximum code length, 0 if error (including code lengths above 63 bits)
+ */
+HOT_FUNCTION
+unsigned char moffatSortedHistNumBits(unsigned int numCodes, unsigned int A[], unsigned int histNumBits[64])
+{
+  LENGTHLIMIT_COUNT(moffatCalls, 1);
+
+  // my allround variable for various loops
+  unsigned int i;
+  for (i = 0; i < 64; i++)
+    histNumBits[i] = 0;
+
+  // handle two pathological cases
+  if (numCodes <= 0)
+    return 0;
+  if (numCodes == 1)
+  {
+    histNumBits[1] = 1;
+    return 1;
+  }
+
+  // phase 1 and 2
+  buildTree(numCodes, A);
+
+  // phase 3: same as moffatSortedInPlace() but just count the leaves at each depth
+  unsigned int  avail = 1;
+  unsigned int  used  = 0;
+  unsigned char depth = 0;
+
+  int root = (int)numCodes - 2;
+  while (avail > 0)
+  {
+    while (root >= 0 && A[root] == depth)
+    {
+      used++;
+      root--;
+    }
+
+    // too long ?
+    if (depth > 63)
+      return 0;
+    histNumBits[depth] = avail - used;
+
+    avail = 2 * used;
+    depth++;
+    used = 0;
+  }
+
+  // the deepest level has no internal nodes
+  return depth - 1;
+}
+
+
+// ----- runs of identical weights -----
+
+// based on Moffat/Turpin: "Efficient Construction of Minimum-Redundancy Codes for Large Alphabets" (1998)
+// - the classic two-queue algorithm (leaves and internal nodes) where each queue element is a run of nodes with the same weight
+// - the smallest run with c nodes becomes a run of c/2 internal nodes with twice its weight,
+//   an odd node is combined with the next smallest node
+// - each run is split at most once, therefore the number of internal runs is small
+// - all nodes with the same weight have the same depth, except for at most one level
+//   (else a deeper node of the same weight had a heavier parent which is deeper than the other node: not optimal)
+//   => all nodes of a run can be described by a depth and the number of nodes which are one level deeper
+
+/// run of nodes with identical weight
+struct RunNode
+{
+  /// weight of each node
+  unsigned long long weight;
+  /// number of nodes
+  unsigned int count;
+  /// leaves: unused, runs of pairs: 2*count nodes of that run are the children, single nodes: first child
+  unsigned int child;
+  /// second child of a single node, NO_CHILD for leaves and runs of pairs
+  unsigned int child2;
+  /// depth of the shallowest node
+  unsigned char depth;
+  /// number of nodes at depth
+  unsigned int numAtDepth;
+  /// number of nodes at depth + 1
+  unsigned int numDeeper;
+};
+
+#define NO_CHILD (~0U)
+
+/// add amount nodes at a certain depth to a run (both depths of a run can be reported in any order)
+static void addDepth(struct RunNode* run, unsigned char depth, unsigned int amount)
+{
+  if (amount == 0)
+    return;
+
+  // first nodes
+  if (run->numAtDepth == 0 && run->numDeeper == 0)
+  {
+    run->depth      = depth;
+    run->numAtDepth = amount;
+    return;
+  }
+
+  if (depth == run->depth)
+    run->numAtDepth += amount;
+  else if (depth == run->depth + 1)
+    run->numDeeper  += amount;
+  else // depth == run->depth - 1, numDeeper must be zero
+  {
+    run->depth      = depth;
+    run->numDeeper  = run->numAtDepth;
+    run->numAtDepth = amount;
+  }
+}
+
+
+/// compute prefix code lengths (Huffman codes) for runs of identical weights (Moffat/Turpin's run-length variant)
+/** weights must be in strictly ascending order and neither a weight nor a multiplicity may be zero
+ *  @param  numRuns      number of runs
+ *  @param  weights      weight of each run's symbols
+ *  @param  multiplicity number of symbols of each run
+ *  @param  codeLengths  (output) computed code lengths
+ *  @param  numLonger    (output) how many symbols of each run need one more bit
+ *  @result maximum code length, 0 if error
+ */
+unsigned char moffatRuns(unsigned int numRuns, const unsigned int weights[], const unsigned int multiplicity[],
+                         unsigned char codeLengths[], unsigned int numLonger[])
+{
+  LENGTHLIMIT_COUNT(moffatCalls, 1);
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  // reject an empty alphabet
+  if (numRuns == 0)
+    return 0;
+
+  // total number of nodes which aren't part of any internal node yet
+  unsigned long long numNodes = 0;
+  for (i = 0; i < numRuns; i++)
+    numNodes += multiplicity[i];
+
+  // a single symbol (Moffat's code would return 0 bits)
+  if (numNodes == 1)
+  {
+    codeLengths[0] = 1;
+    numLonger  [0] = 0;
+    return 1;
+  }
+
+  // leaves first, followed by the internal nodes (which will be appended in ascending order)
+  unsigned int maxRuns = 2 * numRuns + 64;
+  struct RunNode* runs = (struct RunNode*) malloc(sizeof(struct RunNode) * maxRuns);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct RunNode) * maxRuns);
+  for (i = 0; i < numRuns; i++)
+  {
+    runs[i].weight     = weights[i];
+    runs[i].count      = multiplicity[i];
+    runs[i].child      = NO_CHILD;
+    runs[i].child2     = NO_CHILD;
+    runs[i].depth      = 0;
+    runs[i].numAtDepth = 0;
+    runs[i].numDeeper  = 0;
+  }
+  unsigned int numAll = numRuns;
+
+  // front of both queues and how many nodes of their first run were already used
+  unsigned int leaf     = 0;
+  unsigned int leafUsed = 0;
+  unsigned int node     = numRuns;
+  unsigned int nodeUsed = 0;
+
+  // phase 1: build internal nodes
+  while (numNodes > 1)
+  {
+    LENGTHLIMIT_COUNT(iterations, 1);
+
+    // need space for one more run
+    if (numAll == maxRuns)
+    {
+      maxRuns *= 2;
+      runs = (struct RunNode*) realloc(runs, sizeof(struct RunNode) * maxRuns);
+      LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct RunNode) * maxRuns);
+    }
+    struct RunNode* next = &runs[numAll];
+    next->child2     = NO_CHILD;
+    next->depth      = 0;
+    next->numAtDepth = 0;
+    next->numDeeper  = 0;
+
+    // smallest run (prefer leaves if equal weights)
+    int useLeaf = node == numAll || (leaf < numRuns && runs[leaf].weight <= runs[node].weight);
+    unsigned int  smallest = useLeaf ? leaf      : node;
+    unsigned int* used     = useLeaf ? &leafUsed : &nodeUsed;
+    unsigned int  numLeft  = runs[smallest].count - *used;
+
+    if (numLeft >= 2)
+    {
+      // pair as many nodes of that run as possible
+      next->weight = 2 * runs[smallest].weight;
+      next->count  = numLeft / 2;
+      next->child  = smallest;
+      *used    += 2 * next->count;
+      numNodes -= next->count;
+    }
+    else
+    {
+      // combine the single remaining node with the next smallest node
+      next->weight = runs[smallest].weight;
+      next->count  = 1;
+      next->child  = smallest;
+      (*used)++;
+      if (useLeaf)
+      {
+        leaf++;
+        leafUsed = 0;
+      }
+      else
+      {
+        node++;
+        nodeUsed = 0;
+      }
+
+      // note: the new run isn't part of the queue yet, hence "node < numAll" is correct
+      useLeaf  = node == numAll || (leaf < numRuns && runs[leaf].weight <= runs[node].weight);
+      smallest = useLeaf ? leaf      : node;
+      used     = useLeaf ? &leafUsed : &nodeUsed;
+
+      next->weight += runs[smallest].weight;
+      next->child2  = smallest;
+      (*used)++;
+      numNodes--;
+    }
+
+    // run completely processed ?
+    if (leaf < numRuns && leafUsed == runs[leaf].count)
+    {
+      leaf++;
+      leafUsed = 0;
+    }
+    if (node < numAll && nodeUsed == runs[node].count)
+    {
+      node++;
+      nodeUsed = 0;
+    }
+
+    numAll++;
+  }
+
+  // phase 2: the last run is the root, propagate depths from the root to the leaves
+  runs[numAll - 1].numAtDepth = 1;
+  for (i = numAll - 1; i >= numRuns; i--)
+  {
+    struct RunNode* current = &runs[i];
+    unsigned char depth = current->depth + 1;
+    if (current->child2 == NO_CHILD)
+    {
+      // both children of each node belong to the same run
+      addDepth(&runs[current->child], depth,     2 * current->numAtDepth);
+      addDepth(&runs[current->child], depth + 1, 2 * current->numDeeper);
+    }
+    else
+    {
+      // a single node, its children may be stored in different runs
+      addDepth(&runs[current->child],  depth, 1);
+      addDepth(&runs[current->child2], depth, 1);
+    }
+  }
+
+  // phase 3: extract code lengths
+  for (i = 0; i < numRuns; i++)
+  {
+    codeLengths[i] = runs[i].depth;
+    numLonger  [i] = runs[i].numDeeper;
+  }
+
+  free(runs);
+
+  // first run has the longest code because it has the smallest weight
+  return codeLengths[0] + (numLonger[0] > 0 ? 1 : 0);
+}
+
+
+/// same interface as moffatSortedInPlace() but based on moffatRuns(), faster if the histogram contains many identical values
+/** histogram must be in ascending order and no entry must be zero
+ *  @param  numCodes number of elements
+ *  @param  A [in]   how often each code/symbol was found [out] computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+unsigned char moffatRunsSortedInPlace(unsigned int numCodes, unsigned int A[])
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  // handle pathological case
+  if (numCodes == 0)
+    return 0;
+
+  // count runs
+  unsigned int numRuns = 1;
+  for (i = 1; i < numCodes; i++)
+    if (A[i] != A[i - 1])
+      numRuns++;
+
+  // one buffer for all four arrays
+  unsigned int* weights      = (unsigned int*) malloc((3 * sizeof(unsigned int) + sizeof(unsigned char)) * numRuns);
+  LENGTHLIMIT_COUNT(bytesAllocated, (3 * sizeof(unsigned int) + sizeof(unsigned char)) * numRuns);
+  unsigned int* multiplicity = weights      + numRuns;
+  unsigned int* numLonger    = multiplicity + numRuns;
+  unsigned char* codeLengths = (unsigned char*) (numLonger + numRuns);
+
+  // convert histogram to runs
+  unsigned int run = 0;
+  weights     [0] = A[0];
+  multiplicity[0] = 1;
+  for (i = 1; i < numCodes; i++)
+    if (A[i] == A[i - 1])
+      multiplicity[run]++;
+    else
+    {
+      run++;
+      weights     [run] = A[i];
+      multiplicity[run] = 1;
+    }
+
+  unsigned char result = moffatRuns(numRuns, weights, multiplicity, codeLengths, numLonger);
+
+  // code lengths of each symbol (longer codes first)
+  unsigned int pos = 0;
+  for (run = 0; run < numRuns; run++)
+  {
+    for (i = 0; i < numLonger[run]; i++)
+      A[pos++] = codeLengths[run] + 1;
+    for (; i < multiplicity[run]; i++)
+      A[pos++] = codeLengths[run];
+  }
+
+  free(weights);
+
+  return result;
+}
+
+
 // helper struct for qsort()
 struct KeyValue
 {
@@ -138,6 +500,7 @@ unsigned char moffat(unsigned int numCodes, const unsigned int histogram[], unsi
 
   // allocate a buffer for sorting the histogram
   struct KeyValue* mapping = (struct KeyValue*) malloc(sizeof(struct KeyValue) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct KeyValue) * numNonZero);
   // copy histogram to that buffer
   unsigned int storeAt = 0;
   for (i = 0; i < numCodes; i++)
@@ -157,6 +520,7 @@ unsigned char moffat(unsigned int numCodes, const unsigned int histogram[], unsi
 
   // extract ascendingly ordered histogram
   unsigned int* sorted = (unsigned int*) malloc(sizeof(unsigned int) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numNonZero);
   for (i = 0; i < numNonZero; i++)
     sorted[i] = mapping[i].key;
 
@@ -173,3 +537,43 @@ unsigned char moffat(unsigned int numCodes, const unsigned int histogram[], unsi
 
   return result;
 }
+
+
+/// return 1 if Huffman codes are guaranteed to be no longer than maxLength bits, 0 if they might be longer
+/** @param  maxLength    maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  sumHistogram sum of all histogram entries
+ *  @param  minHistogram smallest non-zero histogram entry
+ *  @result 1 if no length-limiting is needed, 0 if unsure
+ */
+int moffatFitsLength(unsigned char maxLength, unsigned long long sumHistogram, unsigned int minHistogram)
+{
+  // let x be a node with weight w(x), p its parent, y its sibling and s the sibling of p
+  // - when x and y were merged, all other nodes (including s or the nodes s will be made of) were at least max(w(x), w(y))
+  // - therefore w(s) >= max(w(x), w(y)) and w(p's parent) = w(p) + w(s)
+  // - the minimum weights on the path from the deepest leaf to the root grow like the Fibonacci numbers:
+  //   min, 2*min, 3*min, 5*min, 8*min, ... = F(2)*min, F(3)*min, F(4)*min, ...
+  // - a Huffman tree with depth d needs sumHistogram >= F(d+2) * min where F(1) = F(2) = 1
+  // => if sumHistogram < F(maxLength+3) * min then depth <= maxLength
+
+  // empty histogram
+  if (minHistogram == 0)
+    return 0;
+
+  // compute F(maxLength+3)
+  unsigned long long previous  = 1; // F(1)
+  unsigned long long fibonacci = 1; // F(2)
+  unsigned int i;
+  for (i = 3; i <= maxLength + 3U; i++)
+  {
+    unsigned long long next = previous + fibonacci;
+    previous  = fibonacci;
+    fibonacci = next;
+
+    // stop early (and avoid any overflow)
+    if (fibonacci > sumHistogram)
+      return 1;
+  }
+
+  // same as sumHistogram < F(maxLength+3) * minHistogram without overflow
+  return sumHistogram / minHistogram < fibonacci;
+}
@@ -5,6 +5,10 @@
 
 #pragma once
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /// compute prefix code lengths (Huffman codes) based on Moffat's in-place algorithm
 /** - given a histogram of all used symbols, this function returns their optimal code length
  *  - this code length can be converted to prefix codes, e.g. canonical prefix codes
@@ -29,6 +33,51 @@
  */
 unsigned char moffatSortedInPlace(unsigned int numCodes, unsigned int A[]);
 
+/// same as moffatSortedInPlace() but returns only the number of codes for each code length
+/** - the code lengths of the sorted histogram are in descending order, therefore they can be easily restored from histNumBits:
+ *    the first histNumBits[maxLength] symbols have maxLength bits, the next histNumBits[maxLength - 1] symbols are one bit shorter, etc.
+ *  - important: the histogram must be in ascending order and no entry must be zero
+ *  - A is used as a temporary buffer, its content is undefined afterwards
+ *  - all 64 entries of histNumBits are initialized by this function, histNumBits[0] is always zero
+ *  @param  numCodes    number of elements
+ *  @param  A           [in] how often each code/symbol was found [out] undefined
+ *  @param  histNumBits [out] histogram of code lengths, must have 64 elements
+ *  @result maximum code length, 0 if error (including code lengths above 63 bits)
+ */
+unsigned char moffatSortedHistNumBits(unsigned int numCodes, unsigned int A[], unsigned int histNumBits[64]);
+
+
+// ---------- runs of identical weights ----------
+
+/// compute prefix code lengths (Huffman codes) for runs of identical weights (Moffat/Turpin's run-length variant)
+/** - large alphabets often contain thousands of symbols with the same count (especially 1 and 2):
+ *    each run is processed as a whole, the time depends on the number of distinct weights instead of the number of symbols
+ *  - run i represents multiplicity[i] symbols, each with weight weights[i]
+ *  - important: weights must be in strictly ascending order and neither a weight nor a multiplicity may be zero
+ *  - all symbols of a run have the same code length, except for at most one bit:
+ *    the first numLonger[i] symbols of run i need codeLengths[i] + 1 bits, all others codeLengths[i] bits
+ *  - example: histogram { 1, 1, 1, 2, 2, 2, 2, 2, 5 }
+ *             => runs: weights { 1, 2, 5 }, multiplicity { 3, 5, 1 }
+ *             => codeLengths { 4, 3, 2 }, numLonger { 0, 1, 0 }
+ *             => code lengths of the whole histogram: { 4, 4, 4, 4, 3, 3, 3, 3, 2 }
+ *  @param  numRuns      number of runs
+ *  @param  weights      weight of each run's symbols
+ *  @param  multiplicity number of symbols of each run
+ *  @param  codeLengths  (output) computed code lengths
+ *  @param  numLonger    (output) how many symbols of each run need one more bit
+ *  @result maximum code length, 0 if error
+ */
+unsigned char moffatRuns(unsigned int numRuns, const unsigned int weights[], const unsigned int multiplicity[],
+                         unsigned char codeLengths[], unsigned int numLonger[]);
+
+/// same interface as moffatSortedInPlace() but based on moffatRuns(), faster if the histogram contains many identical values
+/** histogram must be in ascending order and no entry must be zero
+ *  @param  numCodes number of elements
+ *  @param  A [in]   how often each code/symbol was found [out] computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+unsigned char moffatRunsSortedInPlace(unsigned int numCodes, unsigned int A[]);
+
 
 // ---------- same algorithm with a more convenient interface ----------
 
@@ -39,3 +88,22 @@ unsigned char moffatSortedInPlace(unsigned int numCodes, unsigned int A[]);
  *  @result maximum code length, 0 if error
  */
 unsigned char moffat(unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+
+// ---------- cheap test whether length-limiting is needed at all ----------
+
+/// return 1 if Huffman codes are guaranteed to be no longer than maxLength bits, 0 if they might be longer
+/** - based on the Fibonacci-like growth of node weights along the path from the deepest leaf to the root:
+ *    a Huffman tree with depth d needs sumHistogram >= F(d+2) * minHistogram where F are the Fibonacci numbers
+ *  - thus if sumHistogram < F(maxLength+3) * minHistogram then all code lengths are <= maxLength
+ *  - only a sufficient condition: Huffman codes may fit into maxLength bits even if the function returns 0
+ *  @param  maxLength    maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  sumHistogram sum of all histogram entries
+ *  @param  minHistogram smallest non-zero histogram entry
+ *  @result 1 if no length-limiting is needed, 0 if unsure
+ */
+int moffatFitsLength(unsigned char maxLength, unsigned long long sumHistogram, unsigned int minHistogram);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,346 @@
+// //////////////////////////////////////////////////////////
+// multitable.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "multitable.h"
+#include "packagemerge.h"     // packageMerge
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
+#include <stdlib.h>  // malloc/free
+#include <pthread.h> // pthread_create/pthread_join, mutex and condition variables
+
+
+/// jobs of the thread pool
+enum { JobAssign, JobRebuild, JobQuit };
+
+/// everything shared by all workers
+typedef struct
+{
+  unsigned char        maxLength;
+  unsigned int         numCodes;
+  unsigned int         numSymbols;
+  const unsigned short* symbols;
+  unsigned int         segmentSize;
+  unsigned int         numSegments;
+  unsigned int         numTables;
+  MultiTableAlgorithm  algorithm;
+  unsigned int         numThreads;
+  /// one set of histograms (numTables * numCodes) per worker, the first set is the sum of all after each assignment
+  unsigned int*        histograms;
+  /// code lengths of all tables
+  unsigned char*       codeLengths;
+  /// table of each segment
+  unsigned char*       selectors;
+
+  /// thread pool: the current thread announces a job by incrementing "round" and waits until "busy" drops to zero
+  pthread_mutex_t      mutex;
+  pthread_cond_t       start;
+  pthread_cond_t       finished;
+  unsigned int         round;
+  int                  job;
+  unsigned int         busy;
+} Shared;
+
+/// worker i processes the i-th slice of all segments and the tables i, i + numThreads, i + 2*numThreads, ...
+typedef struct
+{
+  Shared*              shared;
+  unsigned int         index;
+  /// 1 if all tables were rebuilt, 0 if the algorithm failed
+  int                  success;
+} Worker;
+
+/// assign the worker's segments to their cheapest tables and count their symbols in the worker's own histograms
+static void assignSegments(Worker* worker)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  const Shared* shared = worker->shared;
+  unsigned int numCodes  = shared->numCodes;
+  unsigned int numTables = shared->numTables;
+
+  unsigned int* histograms = shared->histograms + worker->index * numTables * numCodes;
+  for (i = 0; i < numTables * numCodes; i++)
+    histograms[i] = 0;
+
+  // contiguous slice of segments
+  unsigned int fromSegment = (unsigned int)(shared->numSegments * (unsigned long long) worker->index       / shared->numThreads);
+  unsigned int toSegment   = (unsigned int)(shared->numSegments * (unsigned long long)(worker->index + 1) / shared->numThreads);
+
+  unsigned int segment;
+  for (segment = fromSegment; segment < toSegment; segment++)
+  {
+    unsigned int first = segment * shared->segmentSize;
+    unsigned int last  = first + shared->segmentSize < shared->numSymbols ? first + shared->segmentSize : shared->numSymbols;
+
+    unsigned int best     = 0;
+    unsigned int bestCost = ~0U;
+    unsigned int table;
+    for (table = 0; table < numTables; table++)
+    {
+      const unsigned char* lengths = shared->codeLengths + table * numCodes;
+      unsigned int cost = 0;
+      for (i = first; i < last; i++)
+        cost += lengths[shared->symbols[i]];
+      if (cost < bestCost)
+      {
+        best     = table;
+        bestCost = cost;
+      }
+    }
+
+    shared->selectors[segment] = (unsigned char) best;
+    unsigned int* histogram = histograms + best * numCodes;
+    for (i = first; i < last; i++)
+      histogram[shared->symbols[i]]++;
+  }
+}
+
+/// rebuild all tables of a worker from the (already reduced) first set of histograms
+static void rebuildTables(Worker* worker)
+{
+  const Shared* shared = worker->shared;
+  worker->success = 1;
+
+  unsigned int table;
+  for (table = worker->index; table < shared->numTables; table += shared->numThreads)
+    if (shared->algorithm(shared->maxLength, shared->numCodes,
+                          shared->histograms  + table * shared->numCodes,
+                          shared->codeLengths + table * shared->numCodes) == 0)
+      worker->success = 0;
+}
+
+/// run a job in a worker
+static void runJob(Worker* worker, int job)
+{
+  if (job == JobAssign)
+    assignSegments(worker);
+  else
+    rebuildTables(worker);
+}
+
+/// pool thread: wait for a job, run it, repeat until JobQuit
+static void* poolThread(void* parameter)
+{
+  Worker* worker = (Worker*) parameter;
+  Shared* shared = worker->shared;
+
+  // the first job may be announced before this thread runs: round starts at zero
+  unsigned int seen = 0;
+  pthread_mutex_lock(&shared->mutex);
+  for (;;)
+  {
+    while (shared->round == seen)
+      pthread_cond_wait(&shared->start, &shared->mutex);
+    seen = shared->round;
+    int job = shared->job;
+    pthread_mutex_unlock(&shared->mutex);
+
+    if (job == JobQuit)
+      return NULL;
+    runJob(worker, job);
+
+    pthread_mutex_lock(&shared->mutex);
+    if (--shared->busy == 0)
+      pthread_cond_signal(&shared->finished);
+  }
+}
+
+/// run a job in all workers, worker 0 runs in the current thread, returns after all are finished
+static void runAll(Shared* shared, Worker workers[], int job)
+{
+  if (shared->numThreads > 1)
+  {
+    pthread_mutex_lock(&shared->mutex);
+    shared->job  = job;
+    shared->busy = shared->numThreads - 1;
+    shared->round++;
+    pthread_cond_broadcast(&shared->start);
+    pthread_mutex_unlock(&shared->mutex);
+  }
+
+  if (job != JobQuit)
+    runJob(&workers[0], job);
+
+  if (shared->numThreads > 1 && job != JobQuit)
+  {
+    pthread_mutex_lock(&shared->mutex);
+    while (shared->busy > 0)
+      pthread_cond_wait(&shared->finished, &shared->mutex);
+    pthread_mutex_unlock(&shared->mutex);
+  }
+}
+
+
+/// assign segments to tables and compute the tables' code lengths
+/** @param  maxLength     maximum code length, e.g. 17 for bzip2
+ *  @param  numCodes      number of codes (alphabet size), all symbols must be smaller
+ *  @param  numSymbols    number of symbols
+ *  @param  symbols       all symbols of the block
+ *  @param  segmentSize   number of symbols per segment (the last segment may be shorter), bzip2: 50
+ *  @param  numTables     number of tables, at most 256, bzip2: 2 to 6
+ *  @param  numIterations how often segments are re-assigned and tables are rebuilt, bzip2: 4
+ *  @param  algorithm     length-limiting algorithm, NULL => packageMerge
+ *  @param  numThreads    assign segments and rebuild tables with up to that many threads, 0 or 1 => no threads
+ *  @param  codeLengths   [out] code lengths of all tables (numTables * numCodes, table after table)
+ *  @param  selectors     [out] table of each segment ((numSymbols + segmentSize - 1) / segmentSize entries)
+ *  @result total size of all symbols in bits (without tables and selectors), 0 if error
+ */
+unsigned long long multiTable(unsigned char maxLength, unsigned int numCodes, unsigned int numSymbols, const unsigned short symbols[],
+                              unsigned int segmentSize, unsigned int numTables, unsigned int numIterations,
+                              MultiTableAlgorithm algorithm, unsigned int numThreads,
+                              unsigned char codeLengths[], unsigned char selectors[])
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  if (numSymbols == 0 || numCodes == 0 || segmentSize == 0 || numTables == 0 || numTables > 256)
+    return 0;
+
+  if (algorithm == NULL)
+    algorithm = packageMerge;
+
+  unsigned int numSegments = (numSymbols + segmentSize - 1) / segmentSize;
+  if (numThreads > 256)
+    numThreads = 256;
+  if (numThreads > numSegments)
+    numThreads = numSegments;
+  if (numThreads == 0)
+    numThreads = 1;
+
+  // each worker has its own histograms, the first set becomes the histogram of the whole block
+  unsigned int* histograms = (unsigned int*) malloc(numThreads * numTables * numCodes * sizeof(unsigned int));
+  LENGTHLIMIT_COUNT(bytesAllocated, numThreads * numTables * numCodes * sizeof(unsigned int));
+  for (i = 0; i < numCodes; i++)
+    histograms[i] = 0;
+  for (i = 0; i < numSymbols; i++)
+  {
+    if (symbols[i] >= numCodes)
+    {
+      free(histograms);
+      return 0;
+    }
+    histograms[symbols[i]]++;
+  }
+
+  // initial tables: split the alphabet into ranges with about the same total frequency,
+  // symbols inside a table's range are "free", all others are expensive (same as bzip2)
+  unsigned int begin     = 0;
+  unsigned int remaining = numSymbols;
+  unsigned int table;
+  for (table = 0; table < numTables; table++)
+  {
+    unsigned int target = remaining / (numTables - table);
+    unsigned int end    = begin;
+    unsigned int sum    = 0;
+    while (sum < target && end < numCodes)
+      sum += histograms[end++];
+    // bzip2 gives the last symbol back to the next range if it overshoots (except for the first and last table)
+    if (end > begin + 1 && table != 0 && table != numTables - 1 && table % 2 == 1)
+      sum -= histograms[--end];
+
+    for (i = 0; i < numCodes; i++)
+      codeLengths[table * numCodes + i] = (i >= begin && i < end) ? 0 : maxLength;
+
+    begin      = end;
+    remaining -= sum;
+  }
+
+  Shared shared;
+  shared.maxLength   = maxLength;
+  shared.numCodes    = numCodes;
+  shared.numSymbols  = numSymbols;
+  shared.symbols     = symbols;
+  shared.segmentSize = segmentSize;
+  shared.numSegments = numSegments;
+  shared.numTables   = numTables;
+  shared.algorithm   = algorithm;
+  shared.numThreads  = numThreads;
+  shared.histograms  = histograms;
+  shared.codeLengths = codeLengths;
+  shared.selectors   = selectors;
+  shared.round       = 0;
+  shared.job         = JobQuit;
+  shared.busy        = 0;
+
+  Worker workers[256];
+  for (i = 0; i < numThreads; i++)
+  {
+    workers[i].shared  = &shared;
+    workers[i].index   = i;
+    workers[i].success = 0;
+  }
+
+  // start the pool once for all iterations, worker 0 runs in the current thread
+  // if a thread can't be created then the work is split among the threads created so far
+  pthread_t threads[256];
+  if (numThreads > 1)
+  {
+    pthread_mutex_init(&shared.mutex,    NULL);
+    pthread_cond_init (&shared.start,    NULL);
+    pthread_cond_init (&shared.finished, NULL);
+    for (i = 1; i < numThreads; i++)
+      if (pthread_create(&threads[i], NULL, poolThread, &workers[i]) != 0)
+        break;
+    shared.numThreads = i;
+  }
+
+  int success = 1;
+  unsigned int iteration;
+  for (iteration = 0; iteration < numIterations && success; iteration++)
+  {
+    LENGTHLIMIT_COUNT(iterations, 1);
+
+    // assign each segment to its cheapest table
+    runAll(&shared, workers, JobAssign);
+
+    // sum of all workers' histograms, the order of additions doesn't matter
+    unsigned int numHistograms = numTables * numCodes;
+    for (i = numHistograms; i < shared.numThreads * numHistograms; i++)
+      histograms[i % numHistograms] += histograms[i];
+
+    // every table must be able to encode every symbol
+    for (i = 0; i < numHistograms; i++)
+      if (histograms[i] == 0)
+        histograms[i] = 1;
+
+    // rebuild tables
+    runAll(&shared, workers, JobRebuild);
+
+    for (i = 0; i < shared.numThreads; i++)
+      if (!workers[i].success)
+        success = 0;
+  }
+
+  // stop the pool
+  if (numThreads > 1)
+  {
+    runAll(&shared, workers, JobQuit);
+    for (i = 1; i < shared.numThreads; i++)
+      pthread_join(threads[i], NULL);
+    pthread_cond_destroy (&shared.finished);
+    pthread_cond_destroy (&shared.start);
+    pthread_mutex_destroy(&shared.mutex);
+  }
+
+  free(histograms);
+
+  // no iteration at all ? => initial tables aren't valid prefix codes
+  if (numIterations == 0 || !success)
+    return 0;
+
+  // size of all segments with their final tables
+  unsigned long long result = 0;
+  unsigned int segment;
+  for (segment = 0; segment < numSegments; segment++)
+  {
+    const unsigned char* lengths = codeLengths + selectors[segment] * numCodes;
+    unsigned int first = segment * segmentSize;
+    unsigned int last  = first + segmentSize < numSymbols ? first + segmentSize : numSymbols;
+    for (i = first; i < last; i++)
+      result += lengths[symbols[i]];
+  }
+
+  return result;
+}
@@ -0,0 +1,49 @@
+// //////////////////////////////////////////////////////////
+// multitable.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bzip2-style clustering: a block is divided into small segments (bzip2: 50 symbols) and each segment picks one of a few tables (bzip2: up to 6)
+// - initially each table is responsible for a range of symbols with about the same total frequency (same as bzip2)
+// - each iteration assigns each segment to the table where it's encoded with the fewest bits,
+//   then each table's code lengths are rebuilt from the histogram of its segments (like k-means)
+// - unused symbols get a count of 1, so that every table can encode every symbol (same as bzip2)
+// - tables are rebuilt by any length-limiting algorithm (default: packageMerge)
+// - optionally in parallel (pthreads): each thread assigns a slice of the segments with its own histograms (which are summed up afterwards)
+//   and rebuilds some of the tables, the threads are started once and re-used by all iterations
+// - example:
+//   unsigned char codeLengths[6 * 258];
+//   unsigned char* selectors = malloc((numSymbols + 49) / 50);
+//   unsigned long long bits = multiTable(17, 258, numSymbols, symbols, 50, 6, 4, limitedBzip2, 6, codeLengths, selectors);
+
+/// same interface as all length-limiting algorithms, e.g. packageMerge or limitedBzip2
+typedef unsigned char (*MultiTableAlgorithm)(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+/// assign segments to tables and compute the tables' code lengths
+/** @param  maxLength     maximum code length, e.g. 17 for bzip2
+ *  @param  numCodes      number of codes (alphabet size), all symbols must be smaller
+ *  @param  numSymbols    number of symbols
+ *  @param  symbols       all symbols of the block
+ *  @param  segmentSize   number of symbols per segment (the last segment may be shorter), bzip2: 50
+ *  @param  numTables     number of tables, at most 256, bzip2: 2 to 6
+ *  @param  numIterations how often segments are re-assigned and tables are rebuilt, bzip2: 4
+ *  @param  algorithm     length-limiting algorithm, NULL => packageMerge
+ *  @param  numThreads    assign segments and rebuild tables with up to that many threads, 0 or 1 => no threads
+ *  @param  codeLengths   [out] code lengths of all tables (numTables * numCodes, table after table)
+ *  @param  selectors     [out] table of each segment ((numSymbols + segmentSize - 1) / segmentSize entries)
+ *  @result total size of all symbols in bits (without tables and selectors), 0 if error
+ */
+unsigned long long multiTable(unsigned char maxLength, unsigned int numCodes, unsigned int numSymbols, const unsigned short symbols[],
+                              unsigned int segmentSize, unsigned int numTables, unsigned int numIterations,
+                              MultiTableAlgorithm algorithm, unsigned int numThreads,
+                              unsigned char codeLengths[], unsigned char selectors[]);
+
+#ifdef __cplusplus
+}
+#endif
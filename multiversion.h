@@ -0,0 +1,19 @@
+// //////////////////////////////////////////////////////////
+// multiversion.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+// compile hot functions multiple times for different x86-64 micro-architecture levels:
+// - the dynamic loader picks the best version for the current CPU (GCC's target_clones => ifunc)
+// - you can ship a single binary which still uses AVX2/AVX-512 if available,
+//   no need for -march=native
+// - enabled by #define LENGTHLIMIT_MULTIVERSION (or: make MULTIVERSION=1),
+//   requires GCC 11+ on x86-64 Linux (glibc), otherwise it's silently ignored
+#if defined(LENGTHLIMIT_MULTIVERSION) && defined(__x86_64__) && defined(__linux__) && \
+    defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#define HOT_FUNCTION __attribute__((target_clones("default", "arch=x86-64-v2", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+#define HOT_FUNCTION
+#endif
@@ -5,6 +5,9 @@
 //
 
 #include "packagemerge.h"
+#include "moffat.h"       // fast path if no length-limiting is needed
+#include "multiversion.h"  // HOT_FUNCTION
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
 #include <stdlib.h>       // malloc/free/qsort
 
 
@@ -12,9 +15,83 @@
 
 // to me the best explanation is Sebastian Gesemann's Bachelor Thesis (in German only / University of Paderborn, 2004)
 
-// data types (switching to unsigned int is faster but fails if sum(histogram) > 2^31 or maxLength > 31)
-typedef unsigned long long BitMask;
-typedef unsigned long long HistItem;
+// data types: package-merge's core is compiled for 32 and 64 bit weights of histogram items and packages
+// and packageMergeSortedInPlace() picks the smallest type that can handle the current histogram and length limit
+// (basically the same as C++ templates, see packagemergecore.h)
+
+// the merge loop of step 1 chooses between the next histogram item and the next package:
+// - by default it's a simple branch which turned out to be well predictable for real-world histograms
+// - #define PACKAGEMERGE_BRANCHLESS to switch to a branchless version (conditional moves and sentinels),
+//   on my Intel CPU it was 10% to 100% slower, even for random histograms
+//   (each iteration's memory accesses depend on the previous iteration's choice: the critical path gets much longer)
+//   => compare both versions on your CPU with ./benchmark -p (shows branch misses)
+//#define PACKAGEMERGE_BRANCHLESS
+
+// sentinels for the branchless merge loop:
+// - an exhausted histogram returns an "infinite" item
+// - an exhausted list of packages returns the sum of two large items, still smaller than the histogram's sentinel
+#define SENTINEL_HISTOGRAM (~(HistItem)0)
+#define SENTINEL_PACKAGE   (SENTINEL_HISTOGRAM >> 2)
+
+/// number of set bits
+static unsigned int countBits(unsigned long long x)
+{
+#ifdef __GNUC__
+  return __builtin_popcountll(x);
+#else
+  unsigned int result = 0;
+  for (; x != 0; x &= x - 1) // clear lowest set bit
+    result++;
+  return result;
+#endif
+}
+
+// weights: 32 bits
+#define HistItem          unsigned int
+#define PACKAGEMERGE_CORE packageMerge32
+#include "packagemergecore.h"
+// weights: 64 bits
+#define HistItem          unsigned long long
+#define PACKAGEMERGE_CORE packageMerge64
+#include "packagemergecore.h"
+
+
+/// same as packageMergeSortedInPlaceNoFastPath() but with an optional workspace (NULL => allocate on the heap)
+static unsigned char packageMergeNoFastPath(unsigned char maxLength, unsigned int numCodes, unsigned int A[], unsigned long long workspace[])
+{
+  // at least one code needs to be in use
+  if (numCodes == 0 || maxLength == 0 || maxLength > 63 || A[0] == 0)
+    return 0;
+
+  // at least log2(numCodes) bits required for every valid prefix code
+  if ((1ULL << maxLength) < numCodes)
+    return 0;
+
+  // one or two codes are always encoded with a single bit
+  if (numCodes <= 2)
+  {
+    A[0] = 1;
+    if (numCodes == 2)
+      A[1] = 1;
+    return 1;
+  }
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  unsigned long long sumHistogram = 0;
+  for (i = 0; i < numCodes; i++)
+    sumHistogram += A[i];
+
+  // choose the smallest data type: less memory means less cache misses
+  // - a package contains at most one symbol of each deeper level,
+  //   therefore its weight can't exceed (maxLength - 1) * sum(histogram)
+  //   (and the sentinels of the branchless merge loop need two more bits)
+  if (sumHistogram * maxLength < (1ULL << 30))
+    return packageMerge32(maxLength, numCodes, A, workspace);
+  return packageMerge64(maxLength, numCodes, A, workspace);
+}
+
 
 /// compute limited prefix code lengths based on Larmore/Hirschberg's package-merge algorithm
 /** - histogram must be in ascending order and no entry must be zero
@@ -22,9 +99,11 @@ typedef unsigned long long HistItem;
  *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
  *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
  *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @param  workspace  at least PACKAGEMERGE_WORKSPACE_WORDS(numCodes, maxLength) elements, NULL => allocate on the heap
  *  @result actual maximum code length, 0 if error
  */
-unsigned char packageMergeSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+HOT_FUNCTION
+unsigned char packageMergeSortedInPlaceWorkspace(unsigned char maxLength, unsigned int numCodes, unsigned int A[], unsigned long long workspace[])
 {
   // skip zeros
   while (numCodes > 0 && A[0] == 0)
@@ -54,8 +133,8 @@ unsigned char packageMergeSortedInPlace(unsigned char maxLength, unsigned int nu
   // my allround variable for various loops
   unsigned int i;
 
-  // check maximum bit length
-  if (maxLength > 8*sizeof(BitMask) - 1) // 8*8-1 = 63
+  // check maximum bit length (unchanged since isMerged was a 64 bit mask per element, any longer code is pointless anyway)
+  if (maxLength > 63)
     return 0;
 
   // at least log2(numCodes) bits required for every valid prefix code
@@ -63,189 +142,64 @@ unsigned char packageMergeSortedInPlace(unsigned char maxLength, unsigned int nu
   if (encodingLimit < numCodes)
     return 0;
 
-  // need two buffers to process iterations and an array of bitmasks
-  unsigned int maxBuffer = 2 * numCodes;
-  // allocate memory
-  HistItem* current  = (HistItem*) malloc(sizeof(HistItem) * maxBuffer);
-  HistItem* previous = (HistItem*) malloc(sizeof(HistItem) * maxBuffer);
-  BitMask*  isMerged = (BitMask*)  malloc(sizeof(BitMask)  * maxBuffer);
-
-  // initial value of "previous" is a plain copy of the sorted histogram
+  // fast path: if unlimited Huffman codes are short enough then they are optimal, too
+  // => Moffat's algorithm is much faster than package-merge
+  unsigned long long sumHistogram = 0;
   for (i = 0; i < numCodes; i++)
-    previous[i] = histogram[i];
-  unsigned int numPrevious = numCodes;
-  // no need to initialize "current", it's completely rebuild every iteration
-
-  // keep track which packages are merged (compact bitmasks):
-  // if package p was merged in iteration i then (isMerged[p] & (1 << i)) != 0
-  for (i = 0; i < maxBuffer; i++)
-    isMerged[i] = 0; // there are no merges before the first iteration
-
-  // the last 2 packages are irrelevant
-  unsigned int numRelevant = 2 * numCodes - 2;
-
-  // ... and preparation is finished
-
-  // //////////////////////////////////////////////////////////////////////
-  // iterate through potential bit lengths while packaging and merging pairs
-  // (step 1 of the algorithm)
-  // - the histogram is sorted (prerequisite of the function)
-  // - the output must be sorted, too
-  // - thus we have to copy the histogram and every and then insert a new package
-  // - the code keeps track of the next package and compares it to
-  //   the next item to be copied from the history
-  // - the smaller value is chosen (if equal, the histogram is chosen)
-  // - a bitmask named isMerged is used to keep track which items were packages
-  // - repeat until the whole histogram was copied and all packages inserted
-
-  // bitmask for isMerged
-  BitMask mask = 1;
-  unsigned char bits;
-  for (bits = maxLength - 1; bits > 0; bits--)
+    sumHistogram += histogram[i];
+  // a) cheap test: guaranteed to be short enough
+  if (moffatFitsLength(maxLength, sumHistogram, histogram[0]))
+    return moffatSortedInPlace(numCodes, A);
+
+  // b) inconclusive: run Moffat's algorithm on a copy of the histogram
+  //    (it's cheap compared to package-merge and length-limiting is often not necessary at all)
+  //    the workspace isn't used by package-merge yet, it's large enough for the copy
+  unsigned int* unlimited = (unsigned int*) workspace;
+  if (workspace == NULL)
   {
-    // ignore last element if numPrevious is odd (can't be paired)
-    numPrevious &= ~1; // bit-twiddling trick to clear the lowest bit, same as numPrevious -= numPrevious % 2
-
-    // first merged package
-    current[0] = histogram[0];              // a sum can't be smaller than its parts
-    current[1] = histogram[1];              // therefore it's impossible to find a package at index 0 or 1
-    HistItem sum = current[0] + current[1]; // same as previous[0] + previous[1]
-
-    // copy histogram and insert merged sums whenever possible
-    unsigned int numCurrent = 2;            // current[0] and current[1] were already set
-    unsigned int numHist    = numCurrent;   // we took them from the histogram
-    unsigned int numMerged  = 0;            // but so far no package inserted (however, it's precomputed in "sum")
-    for (;;) // stop/break is inside the loop
-    {
-      // the next package isn't better than the next histogram item ?
-      if (numHist < numCodes && histogram[numHist] <= sum)
-      {
-        // copy histogram item
-        current[numCurrent++] = histogram[numHist++];
-        continue;
-      }
-
-      // okay, we have a package being smaller than next histogram item
-
-      // mark output value as being "merged", i.e. a package
-      isMerged[numCurrent] |= mask;
-
-      // store package
-      current [numCurrent]  = sum;
-      numCurrent++;
-
-      // already finished last package ?
-      numMerged++;
-      if (numMerged * 2 >= numPrevious)
-        break;
-
-      // precompute next sum
-      sum = previous[numMerged * 2] + previous[numMerged * 2 + 1];
-    }
-
-    // make sure every code from the histogram is included
-    // (relevant if histogram is very skewed with a few outliers)
-    while (numHist < numCodes)
-      current[numCurrent++] = histogram[numHist++];
-
-    // prepare next mask
-    mask <<= 1;
-
-    // performance tweak: abort as soon as "previous" and "current" are identical
-    if (numPrevious >= numRelevant) // ... at least their relevant elements
-    {
-      // basically a bool: FALSE == 0, TRUE == 1
-      char keepGoing = 0;
-
-      // compare both arrays: if they are identical then stop
-      for (i = numRelevant - 1; i > 0; i--) // collisions are most likely at the end
-        if (previous[i] != current[i])
-        {
-          keepGoing++;
-          break;
-        }
-
-      // early exit ?
-      if (keepGoing == 0)
-        break;
-    }
-
-    // swap pointers "previous" and "current"
-    HistItem* tmp = previous;
-    previous = current;
-    current  = tmp;
-
-    // no need to swap their sizes because only numCurrent needed in next iteration
-    numPrevious = numCurrent;
+    unlimited = (unsigned int*) malloc(sizeof(unsigned int) * numCodes);
+    LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numCodes);
   }
-
-  // shifted one bit too far
-  mask >>= 1;
-
-  // keep only isMerged
-  free(previous);
-  free(current);
-
-  // //////////////////////////////////////////////////////////////////////
-  // tracking all merges will produce the code lengths
-  // (step 2 of the algorithm)
-  // - analyze each bitlength's mask in isMerged:
-  //   * a "pure" symbol => increase bitlength of that symbol
-  //   * a merged code   => just increase counter
-  // - stop if no more merged codes found
-  // - if m merged codes were found then only examine
-  //   the first 2*m elements in the next iteration
-  //   (because only they formed these merged codes)
-
-  // reset code lengths
   for (i = 0; i < numCodes; i++)
-    codeLengths[i] = 0;
+    unlimited[i] = histogram[i];
+  int fits = moffatSortedInPlace(numCodes, unlimited) <= maxLength;
+  if (fits)
+    for (i = 0; i < numCodes; i++)
+      codeLengths[i] = unlimited[i];
+  if (workspace == NULL)
+    free(unlimited);
+  if (fits)
+    return codeLengths[0];
+
+  return packageMergeNoFastPath(maxLength, numCodes, A, workspace);
+}
 
-  // start with analyzing the first 2n-2 values
-  unsigned int numAnalyze = numRelevant;
-  while (mask != 0) // stops if nothing but symbols are found in an iteration
-  {
-    // number of merged packages seen so far
-    unsigned int numMerged = 0;
-
-    // the first two elements must be symbols, they can't be packages
-    codeLengths[0]++;
-    codeLengths[1]++;
-    unsigned int symbol = 2;
-
-    // look at packages
-    for (i = symbol; i < numAnalyze; i++)
-    {
-      // check bitmask: not merged if bit is 0
-      if ((isMerged[i] & mask) == 0)
-      {
-        // we have a single non-merged symbol, which needs to be one bit longer
-        codeLengths[symbol]++;
-        symbol++;
-      }
-      else
-      {
-        // we have a merged package, so that its parts need to be checked next iteration
-        numMerged++;
-      }
-    }
-
-    // look only at those values responsible for merged packages
-    numAnalyze = 2 * numMerged;
-
-    // note that the mask was originally slowly shifted left by the merging loop
-    mask >>= 1;
-  }
 
-  // last iteration can't have any merges
-  for (i = 0; i < numAnalyze; i++)
-    codeLengths[i]++;
+/// compute limited prefix code lengths based on Larmore/Hirschberg's package-merge algorithm
+/** - histogram must be in ascending order and no entry must be zero
+ *  - the function rejects maxLength > 63 but I don't see any practical reasons you would need a larger limit ...
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char packageMergeSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+{
+  return packageMergeSortedInPlaceWorkspace(maxLength, numCodes, A, NULL);
+}
 
-  // it's a free world ...
-  free(isMerged);
 
-  // first symbol has the longest code because it's the least frequent in the sorted histogram
-  return codeLengths[0];
+/// same as packageMergeSortedInPlace() but without checking whether Moffat's unlimited Huffman codes are short enough
+/** - histogram must be in ascending order and no entry must be zero
+ *  - only useful if the caller already knows that length-limiting is necessary (e.g. limitedAuto)
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char packageMergeSortedInPlaceNoFastPath(unsigned char maxLength, unsigned int numCodes, unsigned int A[])
+{
+  return packageMergeNoFastPath(maxLength, numCodes, A, NULL);
 }
 
 
@@ -301,6 +255,7 @@ unsigned char packageMerge(unsigned char maxLength, unsigned int numCodes, const
 
   // allocate a buffer for sorting the histogram
   struct KeyValue* mapping = (struct KeyValue*) malloc(sizeof(struct KeyValue) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct KeyValue) * numNonZero);
   // copy histogram to that buffer
   unsigned int storeAt = 0;
   for (i = 0; i < numCodes; i++)
@@ -320,6 +275,7 @@ unsigned char packageMerge(unsigned char maxLength, unsigned int numCodes, const
 
   // extract ascendingly ordered histogram
   unsigned int* sorted = (unsigned int*) malloc(sizeof(unsigned int) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numNonZero);
   for (i = 0; i < numNonZero; i++)
     sorted[i] = mapping[i].key;
 
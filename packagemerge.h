@@ -6,6 +6,10 @@
 
 #pragma once
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /// compute limited prefix code length based on Larmore/Hirschberg's package-merge algorithm
 /** - histogram must be in ascending order and no entry must be zero
  *  - the function rejects maxLength > 63 but I don't see any practical reasons you would need a larger limit ...
@@ -16,6 +20,30 @@
  */
 unsigned char packageMergeSortedInPlace(unsigned char maxLength, unsigned int numCodes, unsigned int A[]);
 
+/// same as packageMergeSortedInPlace() but without checking whether Moffat's unlimited Huffman codes are short enough
+/** - histogram must be in ascending order and no entry must be zero
+ *  - only useful if the caller already knows that length-limiting is necessary (e.g. limitedAuto)
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char packageMergeSortedInPlaceNoFastPath(unsigned char maxLength, unsigned int numCodes, unsigned int A[]);
+
+/// number of 64 bit words needed by packageMergeSortedInPlaceWorkspace()
+#define PACKAGEMERGE_WORKSPACE_WORDS(numCodes, maxLength) (((2 * (numCodes) + 2 + 63) / 64) * (maxLength) + 5 * (numCodes) + 6)
+
+/// same as packageMergeSortedInPlace() but all temporary buffers are located in a caller-provided workspace (no heap allocations)
+/** - histogram must be in ascending order and no entry must be zero
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @param  workspace  at least PACKAGEMERGE_WORKSPACE_WORDS(numCodes, maxLength) elements, NULL => allocate on the heap
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char packageMergeSortedInPlaceWorkspace(unsigned char maxLength, unsigned int numCodes, unsigned int A[], unsigned long long workspace[]);
+
+
 
 // ---------- same algorithm with a more convenient interface ----------
 
@@ -28,3 +56,7 @@ unsigned char packageMergeSortedInPlace(unsigned char maxLength, unsigned int nu
  *  @result actual maximum code length, 0 if error
  */
 unsigned char packageMerge(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+#ifdef __cplusplus
+}
+#endif
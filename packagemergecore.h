@@ -0,0 +1,320 @@
+// //////////////////////////////////////////////////////////
+// packagemergecore.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+// internal file: the core of packageMergeSortedInPlace(), included multiple times by packagemerge.c
+// with different data types (poor man's C++ templates):
+// - #define HistItem          unsigned type of the histogram/package weights
+// - #define PACKAGEMERGE_CORE name of the generated function
+// both macros are undefined at the end of this file
+
+/// compute limited prefix code lengths based on Larmore/Hirschberg's package-merge algorithm
+/** - same as packageMergeSortedInPlace() but without any checks and without fast path
+ *  - histogram must be in ascending order and no entry must be zero, at least 3 codes
+ *  - no package may exceed the range of HistItem
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes, equals the array size of histogram and codeLength
+ *  @param  A [in]     how often each code/symbol was found [out] computed code lengths
+ *  @param  workspace  at least PACKAGEMERGE_WORKSPACE_WORDS(numCodes, maxLength) elements, NULL => allocate on the heap
+ *  @result actual maximum code length, 0 if error
+ */
+HOT_FUNCTION
+static unsigned char PACKAGEMERGE_CORE(unsigned char maxLength, unsigned int numCodes, unsigned int A[], unsigned long long workspace[])
+{
+  // A[] is an input  parameter (stores the histogram) as well as
+  //        an output parameter (stores the code lengths)
+  const unsigned int* histogram   = A;
+  unsigned int*       codeLengths = A;
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  // need two buffers to process iterations and a bitset for each level
+#ifdef PACKAGEMERGE_BRANCHLESS
+  // (plus 2 elements for the sentinels of the merge loop)
+  unsigned int maxBuffer = 2 * numCodes + 2;
+#else
+  unsigned int maxBuffer = 2 * numCodes;
+#endif
+  // allocate memory
+  // (bitsets: one bit per buffer element, stored in 64 bit words)
+  unsigned int numWords  = (maxBuffer + 63) / 64;
+  unsigned int numLevels = maxLength - 1;
+  HistItem* current;
+  HistItem* previous;
+  unsigned long long* isMerged;
+#ifdef PACKAGEMERGE_BRANCHLESS
+  // histogram followed by two sentinels
+  HistItem* items;
+#endif
+  if (workspace == NULL)
+  {
+    current  = (HistItem*) malloc(sizeof(HistItem) * maxBuffer);
+    previous = (HistItem*) malloc(sizeof(HistItem) * maxBuffer);
+    isMerged = (unsigned long long*) malloc(sizeof(unsigned long long) * numWords * numLevels);
+    LENGTHLIMIT_COUNT(bytesAllocated, 2 * sizeof(HistItem) * maxBuffer + sizeof(unsigned long long) * numWords * numLevels);
+#ifdef PACKAGEMERGE_BRANCHLESS
+    items    = (HistItem*) malloc(sizeof(HistItem) * (numCodes + 2));
+    LENGTHLIMIT_COUNT(bytesAllocated, sizeof(HistItem) * (numCodes + 2));
+#endif
+  }
+  else
+  {
+    // caller's buffer: bitsets first (64 bit aligned), then both buffers (HistItem is at most 64 bits)
+    isMerged = workspace;
+    current  = (HistItem*) (workspace + numWords * numLevels);
+    previous = current + maxBuffer;
+#ifdef PACKAGEMERGE_BRANCHLESS
+    items    = previous + maxBuffer;
+#endif
+  }
+
+#ifdef PACKAGEMERGE_BRANCHLESS
+  for (i = 0; i < numCodes; i++)
+    items[i] = histogram[i];
+  items[numCodes]     = SENTINEL_HISTOGRAM;
+  items[numCodes + 1] = SENTINEL_HISTOGRAM;
+#endif
+
+  // initial value of "previous" is a plain copy of the sorted histogram
+  for (i = 0; i < numCodes; i++)
+    previous[i] = histogram[i];
+  unsigned int numPrevious = numCodes;
+  // no need to initialize "current", it's completely rebuild every iteration
+
+  // keep track which packages are merged (one bitset per level):
+  // if package p was merged in iteration l then bit p % 64 of isMerged[l * numWords + p / 64] is set
+  for (i = 0; i < numWords * numLevels; i++)
+    isMerged[i] = 0; // there are no merges before the first iteration
+
+  // the last 2 packages are irrelevant
+  unsigned int numRelevant = 2 * numCodes - 2;
+
+  // ... and preparation is finished
+
+  // //////////////////////////////////////////////////////////////////////
+  // iterate through potential bit lengths while packaging and merging pairs
+  // (step 1 of the algorithm)
+  // - the histogram is sorted (prerequisite of the function)
+  // - the output must be sorted, too
+  // - thus we have to copy the histogram and every and then insert a new package
+  // - the code keeps track of the next package and compares it to
+  //   the next item to be copied from the history
+  // - the smaller value is chosen (if equal, the histogram is chosen)
+  // - a bitset named isMerged is used to keep track which items were packages
+  // - repeat until the whole histogram was copied and all packages inserted
+
+  // number of levels processed so far
+  unsigned int level = 0;
+  unsigned char bits;
+  for (bits = maxLength - 1; bits > 0; bits--)
+  {
+    LENGTHLIMIT_COUNT(iterations, 1);
+
+    // bitset of the current level
+    unsigned long long* merged = isMerged + level * numWords;
+
+    // ignore last element if numPrevious is odd (can't be paired)
+    numPrevious &= ~1; // bit-twiddling trick to clear the lowest bit, same as numPrevious -= numPrevious % 2
+
+#ifdef PACKAGEMERGE_BRANCHLESS
+    // append sentinels (two "packages")
+    previous[numPrevious    ] = SENTINEL_PACKAGE;
+    previous[numPrevious + 1] = SENTINEL_PACKAGE;
+    previous[numPrevious + 2] = SENTINEL_PACKAGE;
+    previous[numPrevious + 3] = SENTINEL_PACKAGE;
+
+    // first merged package
+    current[0] = items[0];                  // a sum can't be smaller than its parts
+    current[1] = items[1];                  // therefore it's impossible to find a package at index 0 or 1
+
+    // all histogram items are copied and all pairs of "previous" become packages
+    unsigned int numCurrent = numCodes + numPrevious / 2;
+
+    // copy histogram and insert merged sums whenever possible
+    // - the loop is branchless: the smaller value is stored and only its index advances
+    // - the next histogram item and the next package are pre-loaded,
+    //   so that memory accesses aren't on the critical path
+    // - sentinels take care of exhausted inputs
+    unsigned int numHist   = 2;                           // current[0] and current[1] were taken from the histogram
+    unsigned int numMerged = 0;                           // but so far no package inserted (however, it's precomputed in "sum")
+    HistItem     hist      = items[2];
+    HistItem     nextHist  = items[3];
+    HistItem     sum       = previous[0] + previous[1];
+    HistItem     nextSum   = previous[2] + previous[3];
+    for (i = 2; i < numCurrent; i++)
+    {
+      // the next package is better than the next histogram item ? (if equal, the histogram is chosen)
+      unsigned int isPackage = sum < hist;
+      // all bits set if package, else zero
+      // (compilers tend to convert the ?: operator into a branch, but not bit masking)
+      HistItem selectPackage = 0 - (HistItem)isPackage;
+
+      // store package or histogram item
+      current [i]  = (sum & selectPackage) | (hist & ~selectPackage);
+      // mark output value as being "merged", i.e. a package
+      merged[i / 64] |= (unsigned long long)isPackage << (i % 64);
+
+      // advance either histogram or packages
+      hist       = (hist & selectPackage) | (nextHist & ~selectPackage);
+      numHist   += 1 - isPackage;
+      nextHist   = items[numHist + 1];
+
+      sum        = (nextSum & selectPackage) | (sum & ~selectPackage);
+      numMerged += isPackage;
+      nextSum    = previous[2 * numMerged + 2] + previous[2 * numMerged + 3];
+    }
+
+#else
+
+    // first merged package
+    current[0] = histogram[0];              // a sum can't be smaller than its parts
+    current[1] = histogram[1];              // therefore it's impossible to find a package at index 0 or 1
+    HistItem sum = current[0] + current[1]; // same as previous[0] + previous[1]
+
+    // copy histogram and insert merged sums whenever possible
+    unsigned int numCurrent = 2;            // current[0] and current[1] were already set
+    unsigned int numHist    = numCurrent;   // we took them from the histogram
+    unsigned int numMerged  = 0;            // but so far no package inserted (however, it's precomputed in "sum")
+    for (;;) // stop/break is inside the loop
+    {
+      // the next package isn't better than the next histogram item ?
+      if (numHist < numCodes && histogram[numHist] <= sum)
+      {
+        // copy histogram item
+        current[numCurrent++] = histogram[numHist++];
+        continue;
+      }
+
+      // okay, we have a package being smaller than next histogram item
+
+      // mark output value as being "merged", i.e. a package
+      merged[numCurrent / 64] |= 1ULL << (numCurrent % 64);
+
+      // store package
+      current [numCurrent]  = sum;
+      numCurrent++;
+
+      // already finished last package ?
+      numMerged++;
+      if (numMerged * 2 >= numPrevious)
+        break;
+
+      // precompute next sum
+      sum = previous[numMerged * 2] + previous[numMerged * 2 + 1];
+    }
+
+    // make sure every code from the histogram is included
+    // (relevant if histogram is very skewed with a few outliers)
+    while (numHist < numCodes)
+      current[numCurrent++] = histogram[numHist++];
+#endif
+
+    // prepare next level
+    level++;
+
+    // performance tweak: abort as soon as "previous" and "current" are identical
+    if (numPrevious >= numRelevant) // ... at least their relevant elements
+    {
+      // basically a bool: FALSE == 0, TRUE == 1
+      char keepGoing = 0;
+
+      // compare both arrays: if they are identical then stop
+      for (i = numRelevant - 1; i > 0; i--) // collisions are most likely at the end
+        if (previous[i] != current[i])
+        {
+          keepGoing++;
+          break;
+        }
+
+      // early exit ?
+      if (keepGoing == 0)
+      {
+        LENGTHLIMIT_COUNT(earlyExits,      1);
+        LENGTHLIMIT_COUNT(earlyExitLevels, maxLength - bits);
+        break;
+      }
+    }
+
+    // swap pointers "previous" and "current"
+    HistItem* tmp = previous;
+    previous = current;
+    current  = tmp;
+
+    // no need to swap their sizes because only numCurrent needed in next iteration
+    numPrevious = numCurrent;
+  }
+
+  // keep only isMerged
+  if (workspace == NULL)
+  {
+#ifdef PACKAGEMERGE_BRANCHLESS
+    free(items);
+#endif
+    free(previous);
+    free(current);
+  }
+
+  // //////////////////////////////////////////////////////////////////////
+  // tracking all merges will produce the code lengths
+  // (step 2 of the algorithm)
+  // - analyze each level's bitset in isMerged, starting with the last level:
+  //   * a "pure" symbol => increase bitlength of that symbol
+  //   * a merged code   => just increase counter
+  // - if m merged codes were found then only examine
+  //   the first 2*m elements in the next iteration
+  //   (because only they formed these merged codes)
+  // - symbols keep their sorted order in each level, therefore the k non-merged elements
+  //   are always the first k symbols: no need to look at single bits, popcount is sufficient
+  // - each level increments a prefix of codeLengths: just mark where each prefix ends
+  //   and accumulate the marks afterwards (from the last symbol to the first)
+
+  // reset code lengths
+  for (i = 0; i < numCodes; i++)
+    codeLengths[i] = 0;
+
+  // start with analyzing the first 2n-2 values
+  unsigned int numAnalyze = numRelevant;
+  while (level > 0)
+  {
+    level--;
+    const unsigned long long* merged = isMerged + level * numWords;
+
+    // count merged packages among the first numAnalyze elements, 64 at once
+    unsigned int numMerged = 0;
+    unsigned int numFull   = numAnalyze / 64;
+    for (i = 0; i < numFull; i++)
+      numMerged += countBits(merged[i]);
+    if (numAnalyze % 64 != 0)
+      numMerged += countBits(merged[numFull] & ((1ULL << (numAnalyze % 64)) - 1));
+
+    // the first two elements must be symbols, they can't be packages
+    unsigned int numSymbols = numAnalyze - numMerged;
+    if (numSymbols < 2)
+      numSymbols = 2;
+    // all these symbols need to be one bit longer
+    codeLengths[numSymbols - 1]++;
+
+    // look only at those values responsible for merged packages
+    numAnalyze = 2 * numMerged;
+  }
+
+  // last iteration can't have any merges
+  if (numAnalyze > 0)
+    codeLengths[numAnalyze - 1]++;
+
+  // convert marks to code lengths
+  for (i = numCodes - 1; i > 0; i--)
+    codeLengths[i - 1] += codeLengths[i];
+
+  // it's a free world ...
+  if (workspace == NULL)
+    free(isMerged);
+
+  // first symbol has the longest code because it's the least frequent in the sorted histogram
+  return codeLengths[0];
+}
+
+#undef HistItem
+#undef PACKAGEMERGE_CORE
@@ -0,0 +1,127 @@
+// //////////////////////////////////////////////////////////
+// perfcounters.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+// syscall() isn't part of C99
+#define _GNU_SOURCE
+
+#include "perfcounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h> // struct perf_event_attr, PERF_*
+#include <sys/ioctl.h>        // ioctl
+#include <sys/syscall.h>      // SYS_perf_event_open
+#include <unistd.h>           // syscall/read/close
+#include <string.h>           // memset
+
+
+/// thin wrapper, glibc doesn't provide perf_event_open()
+static int openEvent(unsigned int type, unsigned long long config)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.disabled       = 1; // start with perfCountersStart()
+  attr.exclude_kernel = 1; // allowed even if perf_event_paranoid is 2
+  attr.exclude_hv     = 1;
+
+  // current process, any CPU, no group
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+
+/// open all counters
+/** @param  counters [out] will be initialized
+ *  @result number of available counters, 0 if none (e.g. not Linux, no permission or virtual machine without PMU)
+ */
+int perfCountersOpen(PerfCounters* counters)
+{
+  // my allround variable for various loops
+  int i;
+  for (i = 0; i < PERF_NUM_EVENTS; i++)
+  {
+    counters->fd       [i] = -1;
+    counters->available[i] = 0;
+    counters->values   [i] = 0;
+  }
+
+#ifdef __linux__
+  counters->fd[PERF_CYCLES]        = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  counters->fd[PERF_INSTRUCTIONS]  = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  counters->fd[PERF_BRANCHES]      = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+  counters->fd[PERF_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  counters->fd[PERF_L1D_MISSES]    = openEvent(PERF_TYPE_HW_CACHE,
+                                               PERF_COUNT_HW_CACHE_L1D |
+                                              (PERF_COUNT_HW_CACHE_OP_READ     <<  8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+
+  int numAvailable = 0;
+  for (i = 0; i < PERF_NUM_EVENTS; i++)
+    if (counters->fd[i] >= 0)
+    {
+      counters->available[i] = 1;
+      numAvailable++;
+    }
+
+  return numAvailable;
+}
+
+
+/// reset all counters and start counting
+void perfCountersStart(PerfCounters* counters)
+{
+#ifdef __linux__
+  int i;
+  for (i = 0; i < PERF_NUM_EVENTS; i++)
+    if (counters->available[i])
+    {
+      ioctl(counters->fd[i], PERF_EVENT_IOC_RESET,  0);
+      ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+  (void) counters; // unused
+#endif
+}
+
+
+/// stop counting and store the results in counters->values
+void perfCountersStop(PerfCounters* counters)
+{
+#ifdef __linux__
+  int i;
+  // disable all counters first, so that reading doesn't count itself
+  for (i = 0; i < PERF_NUM_EVENTS; i++)
+    if (counters->available[i])
+      ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+  for (i = 0; i < PERF_NUM_EVENTS; i++)
+  {
+    counters->values[i] = 0;
+    if (counters->available[i] && read(counters->fd[i], &counters->values[i], sizeof(counters->values[i])) != sizeof(counters->values[i]))
+      counters->available[i] = 0;
+  }
+#else
+  (void) counters; // unused
+#endif
+}
+
+
+/// close all file descriptors
+void perfCountersClose(PerfCounters* counters)
+{
+  int i;
+  for (i = 0; i < PERF_NUM_EVENTS; i++)
+  {
+#ifdef __linux__
+    if (counters->fd[i] >= 0)
+      close(counters->fd[i]);
+#endif
+    counters->fd       [i] = -1;
+    counters->available[i] = 0;
+  }
+}
@@ -0,0 +1,67 @@
+// //////////////////////////////////////////////////////////
+// perfcounters.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// read the CPU's hardware performance counters around a block of code (Linux only, based on perf_event_open)
+// - only user-space events of the current process are counted
+// - counters which aren't supported by the CPU/kernel (or forbidden by /proc/sys/kernel/perf_event_paranoid)
+//   are flagged as unavailable, the program keeps running anyway
+// - on other operating systems no counter is available at all
+// - example:
+//   PerfCounters counters;
+//   perfCountersOpen(&counters);
+//   perfCountersStart(&counters);
+//   ... code to be measured ...
+//   perfCountersStop(&counters);
+//   if (counters.available[PERF_CYCLES] && counters.available[PERF_INSTRUCTIONS])
+//     printf("IPC: %.2f\n", counters.values[PERF_INSTRUCTIONS] / (double) counters.values[PERF_CYCLES]);
+//   perfCountersClose(&counters);
+
+/// supported events
+enum PerfEvent
+{
+  PERF_CYCLES,        ///< CPU cycles
+  PERF_INSTRUCTIONS,  ///< retired instructions
+  PERF_BRANCHES,      ///< retired branch instructions
+  PERF_BRANCH_MISSES, ///< mispredicted branches
+  PERF_L1D_MISSES,    ///< L1 data cache read misses
+
+  PERF_NUM_EVENTS
+};
+
+/// file descriptors and values of all events
+typedef struct
+{
+  /// file descriptors returned by perf_event_open, -1 if unavailable
+  int                fd       [PERF_NUM_EVENTS];
+  /// 1 if an event can be measured, else 0
+  int                available[PERF_NUM_EVENTS];
+  /// measured values of the most recent perfCountersStart/perfCountersStop pair
+  unsigned long long values   [PERF_NUM_EVENTS];
+} PerfCounters;
+
+/// open all counters
+/** @param  counters [out] will be initialized
+ *  @result number of available counters, 0 if none (e.g. not Linux, no permission or virtual machine without PMU)
+ */
+int perfCountersOpen(PerfCounters* counters);
+
+/// reset all counters and start counting
+void perfCountersStart(PerfCounters* counters);
+
+/// stop counting and store the results in counters->values
+void perfCountersStop(PerfCounters* counters);
+
+/// close all file descriptors
+void perfCountersClose(PerfCounters* counters);
+
+#ifdef __cplusplus
+}
+#endif
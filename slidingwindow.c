@@ -0,0 +1,229 @@
+// //////////////////////////////////////////////////////////
+// slidingwindow.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "slidingwindow.h"
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
+#include <stdlib.h> // malloc/free
+
+
+// ----- local helper function -----
+
+// compute log2(x) for x >= 1, no need for math.h / link -lm
+static double preciseLog2(unsigned int x)
+{
+  // unlike fastlog2() in limitedkraft.c this function is slow but precise to about 2^-30:
+  // entropies of large windows are sums of many logarithms and small errors quickly add up,
+  // but it's only called once per table entry in slidingWindowInit()
+
+  double result = 0;
+  double mantissa = x;
+
+  // integer part
+  while (mantissa >= 2)
+  {
+    mantissa /= 2;
+    result++;
+  }
+
+  // fractional part, one bit per iteration:
+  // squaring the mantissa doubles its logarithm, if it exceeds 1 then the current bit is set
+  double bit;
+  for (bit = 0.5; bit > 1e-9; bit /= 2)
+  {
+    mantissa *= mantissa;
+    if (mantissa >= 2)
+    {
+      mantissa /= 2;
+      result   += bit;
+    }
+  }
+
+  return result;
+}
+
+
+// ----- and now externally visible code -----
+
+
+/// allocate memory, the window is empty and no code lengths are built yet
+/** @param  window     internal state
+ *  @param  algorithm  length-limiting algorithm, e.g. limitedKraftHeap
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes / symbols
+ *  @param  windowSize number of symbols in the window
+ *  @param  threshold  rebuild code lengths if estimated loss exceeds this number of bits
+ *  @result 1 if successful, 0 if error
+ */
+int slidingWindowInit(SlidingWindow* window, SlidingWindowAlgorithm algorithm, unsigned char maxLength, unsigned int numCodes, unsigned int windowSize, double threshold)
+{
+  // reject invalid input
+  if (algorithm == 0 || maxLength == 0 || numCodes == 0 || windowSize == 0)
+    return 0;
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  window->algorithm   = algorithm;
+  window->maxLength   = maxLength;
+  window->numCodes    = numCodes;
+  window->windowSize  = windowSize;
+  window->threshold   = threshold;
+
+  window->numSymbols  = 0;
+  window->next        = 0;
+  window->maxBits     = 0;
+  window->failed      = 0;
+  window->numRebuilds = 0;
+
+  window->cost        = 0;
+  window->sumHLogH    = 0;
+  window->redundancy  = 0;
+
+  // allocate memory
+  window->window      = (unsigned int*)  malloc(sizeof(unsigned int)  * windowSize);
+  window->histogram   = (unsigned int*)  malloc(sizeof(unsigned int)  * numCodes);
+  window->codeLengths = (unsigned char*) malloc(sizeof(unsigned char) * numCodes);
+  window->hLogH       = (double*)        malloc(sizeof(double)        * (windowSize + 1));
+  LENGTHLIMIT_COUNT(bytesAllocated, (sizeof(unsigned int) + sizeof(double)) * windowSize + sizeof(double) +
+                                    (sizeof(unsigned int) + sizeof(unsigned char)) * numCodes);
+
+  // empty histogram => no valid codes
+  for (i = 0; i < numCodes; i++)
+  {
+    window->histogram  [i] = 0;
+    window->codeLengths[i] = 0;
+  }
+
+  // a symbol can't be found more often than windowSize times
+  // (and numSymbols * log2(numSymbols) is needed for the entropy, too)
+  window->hLogH[0] = 0;
+  for (i = 1; i <= windowSize; i++)
+    window->hLogH[i] = i * preciseLog2(i);
+
+  return 1;
+}
+
+
+/// release memory
+void slidingWindowFree(SlidingWindow* window)
+{
+  free(window->window);
+  free(window->histogram);
+  free(window->codeLengths);
+  free(window->hLogH);
+
+  window->window      = 0;
+  window->histogram   = 0;
+  window->codeLengths = 0;
+  window->hLogH       = 0;
+}
+
+
+/// estimated number of bits lost by not rebuilding the code lengths
+/** - difference between the redundancy of the current code lengths and their redundancy right after the most recent rebuild
+ *  - redundancy = cost of the code lengths minus entropy of the histogram
+ *  @param  window internal state
+ *  @result estimated loss in bits, may be negative if the current code lengths became a better match
+ */
+double slidingWindowExcess(const SlidingWindow* window)
+{
+  // entropy of the whole window = sum(h * log2(total / h)) = total * log2(total) - sum(h * log2(h))
+  double entropy = window->hLogH[window->numSymbols] - window->sumHLogH;
+
+  // a freshly built code is rarely optimal, too: its redundancy is the baseline
+  return (window->cost - entropy) - window->redundancy;
+}
+
+
+/// unconditionally rebuild code lengths based on the current histogram
+/** @param  window internal state
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char slidingWindowRebuild(SlidingWindow* window)
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  window->numRebuilds++;
+  window->maxBits = window->algorithm(window->maxLength, window->numCodes, window->histogram, window->codeLengths);
+
+  // failed ? (e.g. maxLength too small for the number of used symbols)
+  window->failed = window->maxBits == 0;
+  if (window->failed)
+    for (i = 0; i < window->numCodes; i++)
+      window->codeLengths[i] = 0;
+
+  // full re-computation of cost and sum(h * log2(h)), avoids any drift of the incremental updates
+  window->cost     = 0;
+  window->sumHLogH = 0;
+  for (i = 0; i < window->numCodes; i++)
+  {
+    window->cost     += window->codeLengths[i] * (unsigned long long) window->histogram[i];
+    window->sumHLogH += window->hLogH[window->histogram[i]];
+  }
+
+  // store new baseline
+  window->redundancy = 0;
+  window->redundancy = slidingWindowExcess(window);
+
+  return window->maxBits;
+}
+
+
+/// add a symbol to the window (and remove the oldest if the window is full), rebuild code lengths if necessary
+/** - code lengths are always rebuilt if the new symbol has no valid code yet
+ *  @param  window internal state
+ *  @param  symbol the new symbol, must be less than numCodes
+ *  @result 1 if code lengths were rebuilt, else 0
+ */
+unsigned char slidingWindowAdd(SlidingWindow* window, unsigned int symbol)
+{
+  // window is full => evict oldest symbol
+  if (window->numSymbols == window->windowSize)
+  {
+    unsigned int oldest = window->window[window->next];
+
+    // update sum(h * log2(h)) and cost
+    unsigned int count = window->histogram[oldest];
+    window->sumHLogH  += window->hLogH[count - 1] - window->hLogH[count];
+    window->cost      -= window->codeLengths[oldest];
+    window->histogram[oldest] = count - 1;
+
+    // one symbol less might be sufficient for the algorithm to succeed
+    if (count == 1)
+      window->failed = 0;
+  }
+  else
+    window->numSymbols++;
+
+  // insert new symbol
+  window->window[window->next] = symbol;
+  window->next++;
+  if (window->next == window->windowSize)
+    window->next = 0;
+
+  unsigned int count = window->histogram[symbol];
+  window->sumHLogH  += window->hLogH[count + 1] - window->hLogH[count];
+  window->cost      += window->codeLengths[symbol];
+  window->histogram[symbol] = count + 1;
+
+  // the algorithm failed and no symbol left the window since then => it would fail again
+  if (window->failed)
+    return 0;
+
+  // symbol can't be encoded with the current code lengths
+  if (window->codeLengths[symbol] == 0)
+  {
+    slidingWindowRebuild(window);
+    return 1;
+  }
+
+  // current code lengths still good enough ?
+  if (slidingWindowExcess(window) <= window->threshold)
+    return 0;
+
+  slidingWindowRebuild(window);
+  return 1;
+}
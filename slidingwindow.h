@@ -0,0 +1,119 @@
+// //////////////////////////////////////////////////////////
+// slidingwindow.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// adaptive streaming: a histogram of the most recent windowSize symbols and its code lengths
+// - each new symbol enters the window, the oldest symbol leaves it
+// - rebuilding the code lengths for every symbol would be way too expensive
+// - therefore the cost of the current code lengths is tracked incrementally
+//   and compared to the entropy of the live histogram
+// - code lengths are only rebuilt if the estimated loss exceeds a certain threshold
+// - example:
+//   SlidingWindow window;
+//   slidingWindowInit(&window, limitedKraftHeap, 15, 256, 65536, 1000);
+//   for (i = 0; i < numBytes; i++)
+//   {
+//     // might rebuild window.codeLengths
+//     slidingWindowAdd(&window, data[i]);
+//     // ... encode data[i] with window.codeLengths[data[i]] bits ...
+//   }
+//   slidingWindowFree(&window);
+
+/// same interface as all length-limiting algorithms, e.g. packageMerge or limitedKraftHeap
+typedef unsigned char (*SlidingWindowAlgorithm)(unsigned char maxLength, unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+/// internal state, please don't modify any member
+typedef struct
+{
+  // ----- settings -----
+  /// length-limiting algorithm
+  SlidingWindowAlgorithm algorithm;
+  /// maximum code length
+  unsigned char  maxLength;
+  /// number of codes, equals the array size of histogram and codeLengths
+  unsigned int   numCodes;
+  /// number of symbols in the window
+  unsigned int   windowSize;
+  /// rebuild code lengths if estimated loss exceeds this number of bits
+  double         threshold;
+
+  // ----- sliding window -----
+  /// ring buffer of the most recent symbols
+  unsigned int*  window;
+  /// number of symbols currently in the window (less than windowSize while warming up)
+  unsigned int   numSymbols;
+  /// next write position in the ring buffer
+  unsigned int   next;
+
+  // ----- histogram and its prefix code -----
+  /// how often each symbol was found in the window
+  unsigned int*  histogram;
+  /// code lengths of the most recent rebuild, 0 if a symbol is unused
+  unsigned char* codeLengths;
+  /// longest code length of the most recent rebuild, 0 if not built yet (or the algorithm failed)
+  unsigned char  maxBits;
+  /// 1 if the most recent rebuild failed and no symbol left the window since then (another attempt would fail, too)
+  unsigned char  failed;
+  /// how often code lengths were rebuilt
+  unsigned int   numRebuilds;
+
+  // ----- incrementally tracked cost -----
+  /// sum of codeLengths[i] * histogram[i]
+  unsigned long long cost;
+  /// sum of histogram[i] * log2(histogram[i])
+  double         sumHLogH;
+  /// cost minus entropy right after the most recent rebuild
+  double         redundancy;
+  /// precomputed x * log2(x) for x = 0 ... windowSize
+  double*        hLogH;
+} SlidingWindow;
+
+
+/// allocate memory, the window is empty and no code lengths are built yet
+/** @param  window     internal state
+ *  @param  algorithm  length-limiting algorithm, e.g. limitedKraftHeap
+ *  @param  maxLength  maximum code length, e.g. 15 for DEFLATE or JPEG
+ *  @param  numCodes   number of codes / symbols
+ *  @param  windowSize number of symbols in the window
+ *  @param  threshold  rebuild code lengths if estimated loss exceeds this number of bits
+ *  @result 1 if successful, 0 if error
+ */
+int slidingWindowInit(SlidingWindow* window, SlidingWindowAlgorithm algorithm, unsigned char maxLength, unsigned int numCodes, unsigned int windowSize, double threshold);
+
+/// release memory
+void slidingWindowFree(SlidingWindow* window);
+
+/// add a symbol to the window (and remove the oldest if the window is full), rebuild code lengths if necessary
+/** - code lengths are always rebuilt if the new symbol has no valid code yet
+ *  - if the algorithm failed (e.g. too many symbols for maxLength) then all code lengths are zero
+ *    and the next attempt happens as soon as a symbol completely leaves the window
+ *  @param  window internal state
+ *  @param  symbol the new symbol, must be less than numCodes
+ *  @result 1 if code lengths were rebuilt, else 0
+ */
+unsigned char slidingWindowAdd(SlidingWindow* window, unsigned int symbol);
+
+/// estimated number of bits lost by not rebuilding the code lengths
+/** - difference between the redundancy of the current code lengths and their redundancy right after the most recent rebuild
+ *  - redundancy = cost of the code lengths minus entropy of the histogram
+ *  @param  window internal state
+ *  @result estimated loss in bits, may be negative if the current code lengths became a better match
+ */
+double slidingWindowExcess(const SlidingWindow* window);
+
+/// unconditionally rebuild code lengths based on the current histogram
+/** @param  window internal state
+ *  @result actual maximum code length, 0 if error
+ */
+unsigned char slidingWindowRebuild(SlidingWindow* window);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,196 @@
+// //////////////////////////////////////////////////////////
+// twoqueue.c
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#include "twoqueue.h"
+#include "multiversion.h" // HOT_FUNCTION
+#include "lengthlimitstats.h" // LENGTHLIMIT_COUNT
+#include <stdlib.h> // malloc/free/qsort
+
+// exhausted queues return "infinity"
+#define SENTINEL (~0U)
+
+
+/// compute prefix code lengths (Huffman codes) based on the classic two-queue algorithm (van Leeuwen)
+/** histogram must be in ascending order and no entry must be zero
+ *  @param  numCodes number of elements
+ *  @param  A [in]   how often each code/symbol was found [out] computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+HOT_FUNCTION
+unsigned char twoQueueSortedInPlace(unsigned int numCodes, unsigned int A[])
+{
+  // handle two pathological cases (same as moffatSortedInPlace)
+  if (numCodes == 0)
+    return 0;
+  if (numCodes == 1)
+  {
+    A[0] = 1;
+    return 1;
+  }
+
+  // my allround variable for various loops
+  unsigned int i;
+
+  // leaves (plus a sentinel), weights of internal nodes and their parents (later: their depths)
+  unsigned int* leaves = (unsigned int*) malloc(sizeof(unsigned int) * (3 * numCodes + 1));
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * (3 * numCodes + 1));
+  unsigned int* nodes  = leaves + numCodes + 1;
+  unsigned int* parent = nodes  + numCodes;
+  for (i = 0; i < numCodes; i++)
+    leaves[i] = A[i];
+  leaves[numCodes] = SENTINEL;
+
+  // phase 1: build internal nodes, the front of both queues is at leaves[leaf] and nodes[node]
+  // - the smaller one is chosen, leaves win if equal (same as Moffat's code)
+  // - all choices are made by bit masking instead of branches
+  // - the parent of the front node is always updated, even if it's not chosen:
+  //   it will be overwritten when that node is actually chosen
+  unsigned int leaf = 0;
+  unsigned int node = 0;
+  unsigned int next;
+  for (next = 0; next < numCodes - 1; next++)
+  {
+    // the new node isn't finished yet: it's the sentinel of the internal queue
+    nodes[next] = SENTINEL;
+
+    // first child
+    unsigned int isNode = nodes[node] < leaves[leaf];
+    // all bits set if internal node, else zero
+    unsigned int select = 0 - isNode;
+    unsigned int weight = (nodes[node] & select) | (leaves[leaf] & ~select);
+    parent[node] = next;
+    node += isNode;
+    leaf += 1 - isNode;
+
+    // second child
+    isNode  = nodes[node] < leaves[leaf];
+    select  = 0 - isNode;
+    weight += (nodes[node] & select) | (leaves[leaf] & ~select);
+    parent[node] = next;
+    node += isNode;
+    leaf += 1 - isNode;
+
+    nodes[next] = weight;
+  }
+
+  // phase 2: depth of each internal node, the last one is the root
+  unsigned int* depth = parent; // parent[i] > i, therefore it can be overwritten
+  depth[numCodes - 2] = 0;
+  int j;
+  for (j = numCodes - 3; j >= 0; j--)
+    depth[j] = depth[parent[j]] + 1;
+
+  // phase 3: count leaves at each depth (same as Moffat's code), longest codes belong to the smallest weights
+  unsigned int  avail = 1;
+  unsigned int  used  = 0;
+  unsigned char level = 0;
+
+  int root = (int)numCodes - 2;
+  next = numCodes - 1;
+  while (avail > 0)
+  {
+    while (root >= 0 && depth[root] == level)
+    {
+      used++;
+      root--;
+    }
+    while (avail > used)
+    {
+      A[next] = level;
+      next--;
+      avail--;
+    }
+
+    avail = 2 * used;
+    level++;
+    used = 0;
+  }
+
+  free(leaves);
+
+  // code length is in descending order, thus the first element is the longest
+  return A[0];
+}
+
+
+// the following code is almost identical to function moffat() in moffat.c
+
+
+// helper struct for qsort()
+struct KeyValue
+{
+  unsigned int key;
+  unsigned int value;
+};
+// helper function for qsort()
+static int compareKeyValue(const void* a, const void* b)
+{
+  struct KeyValue* aa = (struct KeyValue*) a;
+  struct KeyValue* bb = (struct KeyValue*) b;
+  return aa->key - bb->key; // negative if a < b, zero if a == b, positive if a > b
+}
+
+
+/// same as before but histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+/** @param  numCodes    number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram   how often each code/symbol was found
+ *  @param  codeLengths (output) computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+unsigned char twoQueue(unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[])
+{
+  // my allround variable for various loops
+  unsigned int i;
+
+  // count non-zero histogram values
+  unsigned int numNonZero = 0;
+  for (i = 0; i < numCodes; i++)
+    if (histogram[i] == 0)
+      codeLengths[i] = 0;
+    else
+      numNonZero++;
+
+  // reject an empty alphabet because malloc(0) is undefined
+  if (numNonZero == 0)
+    return 0;
+
+  // allocate a buffer for sorting the histogram
+  struct KeyValue* mapping = (struct KeyValue*) malloc(sizeof(struct KeyValue) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(struct KeyValue) * numNonZero);
+  // copy histogram to that buffer
+  unsigned int storeAt = 0;
+  for (i = 0; i < numCodes; i++)
+  {
+    // skip zeros
+    if (histogram[i] == 0)
+      continue;
+
+    mapping[storeAt].key   = histogram[i];
+    mapping[storeAt].value = i;
+    storeAt++;
+  }
+
+  // invoke C standard library's qsort
+  qsort(mapping, numNonZero, sizeof(struct KeyValue), compareKeyValue);
+
+  // extract ascendingly ordered histogram
+  unsigned int* sorted = (unsigned int*) malloc(sizeof(unsigned int) * numNonZero);
+  LENGTHLIMIT_COUNT(bytesAllocated, sizeof(unsigned int) * numNonZero);
+  for (i = 0; i < numNonZero; i++)
+    sorted[i] = mapping[i].key;
+
+  // run two-queue algorithm
+  unsigned char result = twoQueueSortedInPlace(numNonZero, sorted);
+
+  // restore original order
+  for (i = 0; i < numNonZero; i++)
+    codeLengths[mapping[i].value] = sorted[i];
+
+  // let it go ...
+  free(sorted);
+  free(mapping);
+
+  return result;
+}
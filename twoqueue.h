@@ -0,0 +1,34 @@
+// //////////////////////////////////////////////////////////
+// twoqueue.h
+// see https://create.stephan-brumme.com/length-limited-prefix-codes/
+//
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// compute prefix code lengths (Huffman codes) based on the classic two-queue algorithm (van Leeuwen)
+/** - same interface and same restrictions as moffatSortedInPlace()
+ *  - leaves and internal nodes are kept in separate queues, both in ascending order
+ *  - each step picks the smaller front element without any branch (plus sentinels for exhausted queues)
+ *  - needs additional memory (3 * numCodes integers) whereas Moffat's algorithm works in-place
+ *  - the sum of the histogram must be smaller than 2^32 - 1
+ *  @param  numCodes number of elements
+ *  @param  A [in] how often each code/symbol was found (ascending order, no zeros) [out] computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+unsigned char twoQueueSortedInPlace(unsigned int numCodes, unsigned int A[]);
+
+/// same as before but histogram can be in any order and may contain zeros, the output is stored in a dedicated parameter
+/** @param  numCodes    number of codes, equals the array size of histogram and codeLength
+ *  @param  histogram   how often each code/symbol was found
+ *  @param  codeLengths (output) computed code lengths
+ *  @result maximum code length, 0 if error
+ */
+unsigned char twoQueue(unsigned int numCodes, const unsigned int histogram[], unsigned char codeLengths[]);
+
+#ifdef __cplusplus
+}
+#endif